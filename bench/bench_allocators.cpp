@@ -0,0 +1,116 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <new>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Allocation overhead of loading a bank with different memory resources.
+    Each load builds one interpolator per voice, drawing its shapes one by one from breakpoints
+    and placing them on the morph axis, then destroys them all, as a synth does when a new bank
+    is selected. Growing the tables shape by shape reallocates them several times, so the load
+    is dominated by allocations rather than by copying points.
+*/
+
+//every heap allocation of the process, aligned ones included
+static std::atomic<size_t> heapAllocations{ 0 };
+
+static void* countedAllocate(size_t bytes, size_t alignment)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (bytes == 0) bytes = 1;
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) p = std::malloc(bytes);
+    else if (posix_memalign(&p, alignment, bytes) != 0) p = nullptr;
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t bytes) { return countedAllocate(bytes, alignof(std::max_align_t)); }
+void* operator new[](size_t bytes) { return countedAllocate(bytes, alignof(std::max_align_t)); }
+void* operator new(size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, static_cast<size_t>(alignment)); }
+void* operator new[](size_t bytes, std::align_val_t alignment) { return countedAllocate(bytes, static_cast<size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+struct LoadCost {
+    double microseconds;
+    double heapAllocations;
+};
+
+template <typename Load>
+LoadCost measureLoads(int loads, Load load)
+{
+    load();  // first use of the resource and of the metrics, not part of the steady state
+
+    size_t allocationsBefore = heapAllocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int l = 0; l < loads; l++) load();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return { elapsed.count() / loads, static_cast<double>(heapAllocations.load() - allocationsBefore) / loads };
+}
+
+static void report(const char* name, LoadCost cost)
+{
+    std::cout << name << cost.microseconds << " us/load, " << cost.heapAllocations << " heap allocations/load\n";
+}
+
+int main()
+{
+    const int envsize = 256;
+    const int numberOfShapes = 16;
+    const int voices = 32;
+    const int loads = 500;
+
+    std::vector<std::vector<std::pair<int, float>>> breakpoints;
+    std::vector<int> peaks;
+    std::vector<float> positions;
+    for (int n = 0; n < numberOfShapes; n++) {
+        int peak = 1 + n * (envsize - 3) / numberOfShapes;
+        breakpoints.push_back({ { 0, 0.0f }, { peak, 1.0f }, { envsize - 1, 0.0f } });
+        peaks.push_back(peak);
+        positions.push_back(n * 1.5f);
+    }
+    const float axisLength = numberOfShapes * 1.5f;
+
+    volatile float sink = 0;
+    auto loadWith = [&](std::pmr::memory_resource* resource) {
+        std::pmr::vector<EnvelopesInterpolator> bank(resource);
+        bank.reserve(voices);
+        for (int v = 0; v < voices; v++) {
+            EnvelopesInterpolator& et = bank.emplace_back(envsize, resource);
+            for (int n = 0; n < numberOfShapes; n++) et.addLinearShape(breakpoints[n], peaks[n]);
+            et.setShapePositions(positions, axisLength);
+        }
+        float sample;
+        bank[voices - 1].interpolateRange(0.5f, envsize / 2, 1, &sample);
+        sink += sample;
+    };
+
+    std::cout << "Bank load, " << voices << " voices of " << numberOfShapes << " shapes x " << envsize << " points\n";
+
+    report("global allocator:     ", measureLoads(loads, [&] { loadWith(std::pmr::new_delete_resource()); }));
+
+    //growing a table leaves its previous storage behind in the arena, hence the margin
+    std::vector<std::byte> arena(static_cast<size_t>(voices) * 4 * numberOfShapes * envsize * sizeof(float));
+    report("monotonic arena:      ", measureLoads(loads, [&] {
+        std::pmr::monotonic_buffer_resource monotonic(arena.data(), arena.size(), std::pmr::null_memory_resource());
+        loadWith(&monotonic);
+    }));
+
+    std::pmr::pool_options options;
+    options.largest_required_pool_block = numberOfShapes * envsize * sizeof(float);
+    std::pmr::unsynchronized_pool_resource pool(options);
+    report("unsynchronized pool:  ", measureLoads(loads, [&] { loadWith(&pool); }));
+
+    return 0;
+}
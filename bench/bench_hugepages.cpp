@@ -0,0 +1,75 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+#include "HugePageResource.h"
+
+/*
+    Random access over a large shape bank, with regular and with huge page backed table storage.
+    Each call morphs a random pair of shapes over a short random range, so that almost every
+    call touches pages that are far apart in the bank: the difference between the two runs is
+    dominated by dTLB misses.
+*/
+
+static double randomAccess(EnvelopesInterpolator& et, int calls, int span)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> sDist(0.0f, static_cast<float>(et.getNumberOfShapes()));
+    std::uniform_int_distribution<int> startDist(0, et.getEnvSize() - span);
+    std::vector<float> out(span);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < calls; c++) {
+        et.interpolateRange(sDist(rng), startDist(rng), span, out.data());
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / calls;
+}
+
+static void fillBank(EnvelopesInterpolator& et, int numberOfShapes)
+{
+    int envsize = et.getEnvSize();
+    std::vector<float> data(static_cast<size_t>(envsize) * numberOfShapes);
+    EnvelopeTable table{ nullptr, envsize, numberOfShapes, {} };
+
+    for (int n = 0; n < numberOfShapes; n++) {
+        int peak = 1 + (n * 7919) % (envsize - 2);
+        for (int x = 0; x < envsize; x++) {
+            float y = (x <= peak) ? static_cast<float>(x) / peak : static_cast<float>(envsize - 1 - x) / (envsize - 1 - peak);
+            data[static_cast<size_t>(n) * envsize + x] = y;
+        }
+        table.peaks.push_back(peak);
+    }
+    table.data = data.data();
+    et.setEnvelopeTable(table);
+}
+
+int main()
+{
+    const int envsize = 65536;
+    const int numberOfShapes = 1024;    // 256 MB bank
+    const int calls = 2000000;
+    const int span = 16;
+
+    std::cout << "Random access, " << numberOfShapes << " shapes x " << envsize << " points ("
+              << static_cast<size_t>(envsize) * numberOfShapes * sizeof(float) / (1024 * 1024) << " MB)\n";
+
+    {
+        EnvelopesInterpolator et(envsize);
+        fillBank(et, numberOfShapes);
+        std::cout << "regular allocation: " << randomAccess(et, calls, span) << " ns/call, backing: "
+                  << HugePageResource::backingName(HugePageResource::queryBacking(et.getShape(0))) << "\n";
+    }
+
+    {
+        HugePageResource hugePages;
+        EnvelopesInterpolator et(envsize, &hugePages);
+        fillBank(et, numberOfShapes);
+        std::cout << "huge page resource: " << randomAccess(et, calls, span) << " ns/call, backing: "
+                  << HugePageResource::backingName(HugePageResource::queryBacking(et.getShape(0)))
+                  << " (requested " << HugePageResource::backingName(hugePages.requestedBacking()) << ")\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "EnvelopeSerialization.h"
+
+/*
+    Throughput of table serialization in each encoding, through memory, a file and a pipe (FIFO,
+    with the reader in another thread), measured against the size of the table in memory.
+*/
+
+static void fillBank(EnvelopesInterpolator& et, int numberOfShapes)
+{
+    int envsize = et.getEnvSize();
+    std::vector<float> data(static_cast<size_t>(envsize) * numberOfShapes);
+    EnvelopeTable table{ nullptr, envsize, numberOfShapes, {} };
+
+    for (int n = 0; n < numberOfShapes; n++) {
+        int peak = 1 + (n * 97) % (envsize - 2);
+        for (int x = 0; x < envsize; x++) {
+            float y = (x <= peak) ? static_cast<float>(x) / peak : static_cast<float>(envsize - 1 - x) / (envsize - 1 - peak);
+            data[static_cast<size_t>(n) * envsize + x] = y * y;
+        }
+        table.peaks.push_back(peak);
+    }
+    table.data = data.data();
+    et.setEnvelopeTable(table);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static float maxDifference(const EnvelopesInterpolator& a, const EnvelopesInterpolator& b)
+{
+    if (a.getEnvSize() != b.getEnvSize() || a.getNumberOfShapes() != b.getNumberOfShapes() || a.getPeaks() != b.getPeaks()) return INFINITY;
+    float difference = 0;
+    size_t count = static_cast<size_t>(a.getEnvSize()) * a.getNumberOfShapes();
+    for (size_t i = 0; i < count; i++) difference = std::max(difference, std::fabs(a.getShape(0)[i] - b.getShape(0)[i]));
+    return difference;
+}
+
+int main()
+{
+    const int envsize = 8192;
+    const int numberOfShapes = 4096;    // 128 MB table
+    const double megabytes = static_cast<double>(envsize) * numberOfShapes * sizeof(float) / 1e6;
+
+    EnvelopesInterpolator et(envsize);
+    fillBank(et, numberOfShapes);
+    std::cout << numberOfShapes << " shapes x " << envsize << " points (" << megabytes << " MB)\n";
+
+    const char* names[] = { "Float32", "Int16", "Int16Delta" };
+    const SampleEncoding encodings[] = { SampleEncoding::Float32, SampleEncoding::Int16, SampleEncoding::Int16Delta };
+
+    for (int e = 0; e < 3; e++) {
+        EnvelopesInterpolator copy(envsize);
+
+        std::stringstream stream;
+        auto start = std::chrono::steady_clock::now();
+        writeEnvelopeTable(stream, et, encodings[e]);
+        double writeTime = seconds(start);
+        size_t bytes = stream.str().size();
+
+        start = std::chrono::steady_clock::now();
+        bool ok = readEnvelopeTable(stream, copy);
+        double readTime = seconds(start);
+
+        std::cout << names[e] << ": " << bytes / 1e6 << " MB, write " << megabytes / writeTime << " MB/s, read "
+                  << megabytes / readTime << " MB/s, " << (ok ? "" : "FAILED, ") << "max error " << maxDifference(et, copy) << "\n";
+    }
+
+    //round trip through a file
+    {
+        const char* path = "/tmp/bench_serialization.envt";
+        EnvelopesInterpolator copy(envsize);
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::ofstream file(path, std::ios::binary);
+            writeEnvelopeTable(file, et);
+        }
+        {
+            std::ifstream file(path, std::ios::binary);
+            readEnvelopeTable(file, copy);
+        }
+        std::cout << "file round trip: " << megabytes / seconds(start) << " MB/s, max error " << maxDifference(et, copy) << "\n";
+        std::remove(path);
+    }
+
+    //round trip through a pipe, followed by a patch
+    {
+        const char* path = "/tmp/bench_serialization.fifo";
+        std::remove(path);
+        if (mkfifo(path, 0600) != 0) return 1;
+
+        EnvelopesInterpolator copy(envsize);
+        bool ok = false;
+        auto start = std::chrono::steady_clock::now();
+        std::thread reader([&] {
+            std::ifstream pipe(path, std::ios::binary);
+            ok = readEnvelopeTable(pipe, copy) && applyShapePatch(pipe, copy);
+        });
+        {
+            std::ofstream pipe(path, std::ios::binary);
+            writeEnvelopeTable(pipe, et);
+            std::vector<float> shape(et.getShape(7), et.getShape(7) + envsize);
+            for (float& y : shape) y *= 0.5f;
+            et.replaceShape(7, shape.data(), et.getPeaks()[7]);
+            writeShapePatch(pipe, et, 7);
+        }
+        reader.join();
+        std::cout << "pipe round trip with patch: " << megabytes / seconds(start) << " MB/s, " << (ok ? "" : "FAILED, ")
+                  << "max error " << maxDifference(et, copy) << "\n";
+        std::remove(path);
+    }
+
+    return 0;
+}
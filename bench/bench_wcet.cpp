@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Worst-case execution time of interpolate and interpolateConstantTime over adversarial peak
+    configurations. Each configuration is swept over values of s chosen to exercise every path of
+    the regular kernel: integer s (copy shortcut), values just above and below an integer (ghost
+    peak at one extreme), and midpoints. Each (configuration, s) call is timed many times and its
+    fastest run kept, filtering out preemption and interrupts, then the slowest and fastest s are reported: the
+    spread shows how much the cost depends on s. The spread over all configurations, reported last, shows
+    how much it depends on the peaks.
+*/
+
+struct Configuration {
+    std::string name;
+    std::vector<int> peaks;
+};
+
+static EnvelopesInterpolator makeInterpolator(int envsize, const std::vector<int>& peaks)
+{
+    EnvelopesInterpolator et(envsize);
+    std::vector<std::vector<std::pair<int, float>>> shapes;
+    for (int peak : peaks) shapes.push_back({ { 0, 0.0f }, { peak, 1.0f }, { envsize - 1, 0.0f } });
+    et.addLinearShapes(shapes, peaks, 1);
+    return et;
+}
+
+//fastest of repetitions runs of each call, round robin over the calls so that drifts in clock
+//frequency or machine load affect all of them alike
+template <typename Render>
+static std::vector<double> fastestCalls(const std::vector<float>& factors, Render render, int repetitions)
+{
+    std::vector<double> fastest(factors.size(), 1e30);
+    for (int r = 0; r < repetitions; r++) {
+        for (size_t i = 0; i < factors.size(); i++) {
+            auto start = std::chrono::steady_clock::now();
+            render(factors[i]);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            fastest[i] = std::min(fastest[i], elapsed.count());
+        }
+    }
+    return fastest;
+}
+
+int main()
+{
+    const int envsize = 4096;
+    const int repetitions = 200;
+    const int last = envsize - 2;
+
+    std::vector<Configuration> configurations = {
+        { "extremes alternating", { 1, last, 1, last } },
+        { "all at start", { 1, 1, 1, 1 } },
+        { "all at end", { last, last, last, last } },
+        { "centered", { envsize / 2, envsize / 2, envsize / 2, envsize / 2 } },
+        { "near extremes", { 2, last - 1, 1, last } },
+    };
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> peakDistribution(1, last);
+    std::vector<int> randomPeaks(8);
+    for (int& peak : randomPeaks) peak = peakDistribution(rng);
+    configurations.push_back({ "random", randomPeaks });
+
+    std::vector<float> out(envsize);
+    double worstRegular = 0, worstConstant = 0;
+    double bestRegular = 1e30, bestConstant = 1e30;
+
+    for (const Configuration& configuration : configurations) {
+        EnvelopesInterpolator et = makeInterpolator(envsize, configuration.peaks);
+        int shapes = et.getNumberOfShapes();
+
+        std::vector<float> factors;
+        for (int n = 0; n < shapes; n++) {
+            for (float offset : { 0.0f, 1e-6f, 0.001f, 0.25f, 0.5f, 0.75f, 0.999f, 0.999999f }) factors.push_back(n + offset);
+        }
+
+        std::vector<double> regular = fastestCalls(factors, [&](float s) { et.interpolate(s, out.data()); }, repetitions);
+        std::vector<double> constant = fastestCalls(factors, [&](float s) { et.interpolateConstantTime(s, out.data()); }, repetitions);
+        double minRegular = *std::min_element(regular.begin(), regular.end());
+        double maxRegular = *std::max_element(regular.begin(), regular.end());
+        double minConstant = *std::min_element(constant.begin(), constant.end());
+        double maxConstant = *std::max_element(constant.begin(), constant.end());
+        worstRegular = std::max(worstRegular, maxRegular);
+        worstConstant = std::max(worstConstant, maxConstant);
+        bestRegular = std::min(bestRegular, minRegular);
+        bestConstant = std::min(bestConstant, minConstant);
+
+        std::cout << configuration.name << ": interpolate " << minRegular << " - " << maxRegular << " ns, constant time "
+                  << minConstant << " - " << maxConstant << " ns (spread over s " << maxConstant / minConstant << "x)\n";
+    }
+
+    std::cout << "over all configurations (" << envsize << " points): interpolate " << bestRegular << " - " << worstRegular
+              << " ns, constant time " << bestConstant << " - " << worstConstant << " ns (spread " << worstConstant / bestConstant << "x)\n";
+    return 0;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/*
+    Changes between two successive renders of an envelope, as (start, length, data) runs, to
+    mirror a rendered buffer to a remote consumer with a bandwidth proportional to what changed
+    rather than to the envelope size.
+
+    A sample is part of a run when it moved by more than the threshold. Runs separated by at most
+    mergeGap unchanged samples are merged, since a run header costs as much as a couple of samples.
+    Unchanged samples are never updated on the producer side either, so that its buffer stays
+    identical to the consumer's copy once the patch is applied: with a threshold above zero, the
+    mirrored envelope differs from the exact render by at most the threshold, without drifting.
+*/
+
+struct DeltaRun {
+    int start;      // index of the first sample of the run in the envelope
+    int length;     // number of samples
+    int offset;     // index of the first sample of the run in DeltaStream::data()
+};
+
+class DeltaStream
+{
+public:
+    DeltaStream(float threshold = 0.0f, int mergeGap = 4) : _threshold(threshold), _mergeGap(mergeGap > 0 ? mergeGap : 0) {}
+
+    void setThreshold(float threshold) { _threshold = threshold; }
+    void setMergeGap(int mergeGap) { _mergeGap = mergeGap > 0 ? mergeGap : 0; }
+
+    //forgets the runs of the previous render
+    void clear()
+    {
+        _runs.clear();
+        _data.clear();
+        _pending = 0;
+        _open = false;
+    }
+
+    /**
+      * @brief Compares a freshly rendered block with the previous contents of the buffer, appending
+      *        changed samples to the runs and writing them to the buffer. Blocks are meant to be
+      *        added in order, right after being rendered.
+      *
+      * @param rendered count new samples.
+      * @param buffer The same count samples of the previous render, updated in place.
+      * @param start Index of the first sample of the block in the envelope.
+      */
+    void add(const float* rendered, float* buffer, int start, int count)
+    {
+        //first a branch-free pass comparing and updating the samples, which vectorizes, then the
+        //extraction of the runs from its mask, which cannot
+        int changed[maskBlockSize];
+        for (int base = 0; base < count; base += maskBlockSize) {
+            int n = std::min(maskBlockSize, count - base);
+            markChanges(rendered + base, buffer + base, changed, n);
+            extractRuns(changed, buffer + base, start + base, n);
+        }
+    }
+
+    //to be called after the last block, dropping unchanged samples left at the end of the last run
+    void finish()
+    {
+        _data.resize(_data.size() - _pending);
+        _pending = 0;
+        _open = false;
+    }
+
+    /**
+      * @brief Applies the runs to a copy of the previous render, making it equal to the producer's buffer.
+      */
+    void applyTo(float* buffer) const
+    {
+        for (const DeltaRun& run : _runs) {
+            const float* source = _data.data() + run.offset;
+            for (int i = 0; i < run.length; i++) buffer[run.start + i] = source[i];
+        }
+    }
+
+    const std::vector<DeltaRun>& runs() const { return _runs; }
+    const std::vector<float>& data() const { return _data; }
+    bool empty() const { return _runs.empty(); }
+
+    //size of the runs once sent: two ints of header per run plus the samples
+    std::size_t encodedBytes() const { return _runs.size() * 2 * sizeof(int) + _data.size() * sizeof(float); }
+
+private:
+    //samples compared per pass; the mask stays on the stack
+    static constexpr int maskBlockSize = 64;
+
+    //changed[i] is 1 where the sample moved by more than the threshold, the buffer taking the new value
+    void markChanges(const float* rendered, float* buffer, int* changed, int count) const
+    {
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            //four samples loaded before any store: the lanes vectorize at -O2 without alias checks
+            float r[4], b[4];
+            int moved[4];
+            for (int k = 0; k < 4; k++) {
+                r[k] = rendered[i + k];
+                b[k] = buffer[i + k];
+            }
+            for (int k = 0; k < 4; k++) moved[k] = std::fabs(r[k] - b[k]) > _threshold;
+            for (int k = 0; k < 4; k++) buffer[i + k] = moved[k] ? r[k] : b[k];
+            for (int k = 0; k < 4; k++) changed[i + k] = moved[k];
+        }
+        for (; i < count; i++) {
+            int moved = std::fabs(rendered[i] - buffer[i]) > _threshold;
+            buffer[i] = moved ? rendered[i] : buffer[i];
+            changed[i] = moved;
+        }
+    }
+
+    //appends the runs of a compared block, whose buffer already holds the samples to send
+    void extractRuns(const int* changed, const float* buffer, int start, int count)
+    {
+        for (int i = 0; i < count; i++) {
+            if (changed[i]) {
+                if (_open) {
+                    //within mergeGap of the open run: the unchanged samples in between join it
+                    _runs.back().length += _pending + 1;
+                }
+                else {
+                    _runs.push_back({start + i, 1, static_cast<int>(_data.size())});
+                    _open = true;
+                }
+                _pending = 0;
+                _data.push_back(buffer[i]);
+            }
+            else if (_open && _pending < _mergeGap) {
+                //kept aside in case another change follows within mergeGap samples
+                _data.push_back(buffer[i]);
+                _pending++;
+            }
+            else if (_open) {
+                _data.resize(_data.size() - _pending);
+                _pending = 0;
+                _open = false;
+            }
+        }
+    }
+
+    float _threshold;
+    int _mergeGap;
+    std::vector<DeltaRun> _runs;
+    std::vector<float> _data;
+    int _pending = 0;   // unchanged samples at the end of _data, not yet part of the open run
+    bool _open = false; // whether the next change may still extend the last run
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Process-wide metrics of the library, for long-running render services.
+
+    Every thread updates a shard of its own, aligned to a cache line: a hot-path update is a
+    relaxed load and store on memory no other thread writes, so render threads never contend.
+    Readers (snapshot, exporters) sum the shards. A thread's shard is handed to the next thread
+    created once it exits, keeping the number of shards bounded by the peak number of threads;
+    since metrics are cumulative, the values it holds stay valid. Taking a shard, on the first
+    update of a thread, locks and may allocate: see registerThread.
+
+    The interpolators report calls, rendered samples, rejected inputs (s out of range, invalid
+    arguments or tables) and table swaps. Render latency costs two clock reads per call and is
+    only measured once enabled with setTimingEnabled. Cache hits and misses are there for render
+    caches built on top of the library, which report them with add().
+*/
+
+enum class Metric {
+    Calls,
+    RenderedSamples,
+    RejectedInputs,
+    TableSwaps,
+    CacheHits,
+    CacheMisses,
+    Count
+};
+
+struct MetricsSnapshot {
+    static constexpr int latencyBuckets = 40;   // bucket b holds latencies in (2^(b-1), 2^b] ns, bucket 0 up to 1 ns
+
+    std::array<std::uint64_t, static_cast<int>(Metric::Count)> counters{};
+    std::array<std::uint64_t, latencyBuckets> latency{};
+    std::uint64_t latencySumNs = 0;
+
+    std::uint64_t operator[](Metric m) const { return counters[static_cast<int>(m)]; }
+};
+
+class MetricsRegistry
+{
+public:
+    struct alignas(64) Shard {
+        std::array<std::atomic<std::uint64_t>, static_cast<int>(Metric::Count)> counters{};
+        std::array<std::atomic<std::uint64_t>, MetricsSnapshot::latencyBuckets> latency{};
+        std::atomic<std::uint64_t> latencySumNs{ 0 };
+        std::atomic<bool> inUse{ false };
+
+        //only the owning thread writes, so no read-modify-write is needed
+        void add(Metric m, std::uint64_t value)
+        {
+            auto& counter = counters[static_cast<int>(m)];
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void addLatency(std::uint64_t ns);
+    };
+
+    static MetricsRegistry& global();
+
+    //shard of the calling thread
+    Shard& local();
+
+    //takes the calling thread's shard ahead of time: the first use of the registry on a thread
+    //locks a mutex and may allocate, so real-time threads call this before entering their loop
+    void registerThread() { local(); }
+
+    void add(Metric m, std::uint64_t value = 1) { local().add(m, value); }
+
+    void setTimingEnabled(bool enabled) { _timingEnabled.store(enabled, std::memory_order_relaxed); }
+    bool timingEnabled() const { return _timingEnabled.load(std::memory_order_relaxed); }
+
+    MetricsSnapshot snapshot() const;
+
+    //Prometheus text exposition format, metric names prefixed with envelopes_
+    void writePrometheus(std::ostream& os) const;
+
+private:
+    MetricsRegistry() = default;
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::atomic<bool> _timingEnabled{ false };
+};
+
+/*
+    Counts one render call of count samples, timing it when timing is enabled.
+*/
+class RenderMetricsScope
+{
+public:
+    explicit RenderMetricsScope(int samples) : _shard(MetricsRegistry::global().local())
+    {
+        _shard.add(Metric::Calls, 1);
+        _shard.add(Metric::RenderedSamples, static_cast<std::uint64_t>(samples > 0 ? samples : 0));
+        if (MetricsRegistry::global().timingEnabled()) _start = std::chrono::steady_clock::now();
+    }
+
+    ~RenderMetricsScope()
+    {
+        if (_start == std::chrono::steady_clock::time_point()) return;
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start);
+        _shard.addLatency(static_cast<std::uint64_t>(elapsed.count()));
+    }
+
+    RenderMetricsScope(const RenderMetricsScope&) = delete;
+    RenderMetricsScope& operator=(const RenderMetricsScope&) = delete;
+
+private:
+    MetricsRegistry::Shard& _shard;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/*
+    Publishes the global registry in Prometheus text format, from a background thread: either
+    rewritten to a file at a fixed interval (for node_exporter's textfile collector, the file is
+    replaced atomically), or served to every client connecting to a local Unix socket.
+*/
+class MetricsExporter
+{
+public:
+    MetricsExporter() = default;
+    ~MetricsExporter() { stop(); }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    //return false if the exporter is already running or the socket cannot be bound
+    bool startFile(const std::string& path, std::chrono::milliseconds interval);
+    bool startSocket(const std::string& path);
+    void stop();
+
+private:
+    std::thread _thread;
+    std::atomic<bool> _running{ false };
+    int _socket = -1;
+    std::string _socketPath;
+};
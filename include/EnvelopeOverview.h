@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Min/max overview of interpolated envelopes, for drawing them at any zoom level.
+
+    At construction, a min/max pyramid is built for each shape (level l holds the min and max of
+    blocks of 2^l points). Drawing a morph maps each pixel column back to the source ranges of
+    the two shapes through the peak alignment, reads their min/max from the pyramids, and blends
+    them: the cost is O(width * log(envsize)) instead of O(envsize).
+
+    Since min and max of a blend are bounded by the blend of the mins and maxes, the columns are
+    conservative bounds of the exact morph, and exact for integer values of s. The pyramids count
+    in MemoryTracker::global(), under caches.
+*/
+
+class EnvelopeOverview
+{
+public:
+    /**
+      * @param et Interpolator to draw, which must outlive the overview. Rebuild the overview when
+      *           its table changes.
+      */
+    EnvelopeOverview(const EnvelopesInterpolator& et);
+
+    /**
+      * @brief Min and max of the interpolated shape for each of width pixel columns.
+      *
+      * @param s Interpolation factor (0.0 ≤ s ≤ numberOfShapes).
+      * @param width Number of columns.
+      * @param mins Output buffer of width values.
+      * @param maxs Output buffer of width values.
+      */
+    void render(float s, int width, float* mins, float* maxs) const;
+
+    std::size_t memoryBytes() const { return (_mins.size() + _maxs.size()) * sizeof(float); }
+
+private:
+    const EnvelopesInterpolator& _et;
+    int _envsize;
+    int _levels;
+    std::vector<int> _levelOffset;  // offset of each level (from 1) within the pyramid of a shape
+    int _pyramidSize;               // entries per shape
+    std::vector<float> _mins;
+    std::vector<float> _maxs;
+    TrackedCacheMemory _trackedMemory;
+
+    //min and max of shape points [a, b]
+    void rangeMinMax(int shape, int a, int b, float& min, float& max) const;
+
+    //min and max of a shape over the output range [x0, x1], once stretched to the ghost peak
+    void warpedMinMax(int shape, float ghost_peak_xpos, float x0, float x1, float& min, float& max) const;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "EnvelopesInterpolator.h"
+
+/*
+    Plays an interpolated envelope sample by sample, with a sustain loop held while the note is
+    on and a release on note-off, without ever rendering the whole envelope.
+
+    The read position is kept relative to the peak-aligned geometry of the morph: a phase in
+    [0, 1] across the attack (start to peak) and another in [0, 1] across the decay (peak to end).
+    Loop and release points are expressed in decay phase. Since interpolation stretches each part of
+    the shapes to the ghost peak, a given phase reads the same relative point of the source shapes
+    whatever s is, so changing s mid-note moves the output continuously.
+
+    When note-off moves the read position to the release point, the jump in value is smoothed out
+    by an offset fading to zero over releaseFade samples.
+*/
+
+class EnvelopePlayer
+{
+public:
+    enum class Stage {
+        Idle,
+        Attack,
+        Decay,      // after the peak, looping between the loop points while the note is held
+        Release,
+        Finished
+    };
+
+    /**
+      * @param et Interpolator to read from, which must outlive the player.
+      * @param increment Envelope points advanced per output sample.
+      */
+    EnvelopePlayer(const EnvelopesInterpolator& et, float increment = 1.0f);
+
+    /**
+      * @brief Sets the sustain loop, in decay phase (0 = peak, 1 = end). loopEnd ≤ loopStart disables it.
+      */
+    void setSustainLoop(float loopStart, float loopEnd);
+
+    /**
+      * @brief Sets where playback continues from on note-off, in decay phase. A negative value
+      *        continues from the current position.
+      */
+    void setReleasePoint(float releasePoint);
+
+    void setReleaseFade(int samples) { _releaseFade = samples > 0 ? samples : 0; }
+    void setIncrement(float increment) { _increment = increment; }
+
+    void noteOn();
+    void noteOff();
+
+    /**
+      * @brief Next output sample, for the interpolation factor s.
+      */
+    float process(float s);
+    void process(float s, float* targetbuffer, int numSamples);
+
+    Stage getStage() const { return _stage; }
+
+private:
+    const EnvelopesInterpolator& _et;
+    float _increment;
+    float _loopStart;
+    float _loopEnd;
+    float _releasePoint;
+    int _releaseFade;
+
+    Stage _stage;
+    bool _gate;
+    float _phase;       // attack phase during Attack, decay phase afterwards
+    float _lastOutput;
+    float _offset;      // declick offset, fading to zero
+    int _offsetSamples;
+};
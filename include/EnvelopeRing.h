@@ -0,0 +1,254 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+
+/*
+    Ring of pre-allocated envelope buffers, generalizing DoubleBuffer to several envelopes in
+    flight between render threads and consumers.
+
+    Slots go round in order. A producer acquires the next free slot, renders into it in place and
+    commits it; a consumer acquires the oldest committed slot, reads it in place and releases it,
+    making it free again. Nothing is copied. Each slot carries a sequence number, counting the
+    envelopes written since the ring was created, so consumers can tell them apart and detect
+    ordering. The ring is lock-free and safe with any number of producers and consumers (bounded
+    MPMC queue with a sequence per cell), single producer and consumer being the common case.
+
+    When the ring is full, tryAcquireWrite fails and the producer decides what to do (drop the
+    render, retry later): that is the backpressure. acquireWrite and acquireRead wait instead,
+    spinning then yielding.
+
+    Slot buffers are 64-byte aligned and padded to whole cache lines, so that threads working on
+    neighbouring slots never share a line. The time between commit and read acquisition of each
+    envelope is gathered in a log2 histogram, see getLatencyStats.
+*/
+
+class EnvelopeRing
+{
+public:
+    struct WriteSlot {
+        float* data = nullptr;
+        std::uint64_t sequence = 0;
+    };
+
+    struct ReadSlot {
+        const float* data = nullptr;
+        std::uint64_t sequence = 0;
+    };
+
+    struct LatencyStats {
+        std::uint64_t count = 0;        // envelopes read
+        double meanNs = 0;              // mean time from commit to read acquisition
+        double maxNs = 0;
+        double p50Ns = 0;               // percentiles, as upper bounds of their power of two bucket
+        double p99Ns = 0;
+        std::uint64_t fullEvents = 0;   // failed write acquisitions: backpressure applied to producers
+        std::uint64_t emptyEvents = 0;  // failed read acquisitions
+    };
+
+    /**
+      * @param envsize Number of points of each envelope.
+      * @param slots Number of envelopes in flight, rounded up to a power of two (≥ 2).
+      */
+    EnvelopeRing(int envsize, int slots)
+        : _envsize(envsize), _stride(strideOf(envsize)), _capacity(roundUpToPowerOfTwo(slots)), _mask(_capacity - 1)
+    {
+        _memory = static_cast<float*>(::operator new(_stride * _capacity * sizeof(float), std::align_val_t(cacheLine)));
+        _cells = new Cell[_capacity];
+        for (std::size_t i = 0; i < _capacity; i++) _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~EnvelopeRing()
+    {
+        delete[] _cells;
+        ::operator delete(_memory, std::align_val_t(cacheLine));
+    }
+
+    EnvelopeRing(const EnvelopeRing&) = delete;
+    EnvelopeRing& operator=(const EnvelopeRing&) = delete;
+
+    //acquires the next free slot for writing, false if the ring is full
+    bool tryAcquireWrite(WriteSlot& slot)
+    {
+        std::uint64_t position = _writePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[position & _mask];
+            std::int64_t difference = static_cast<std::int64_t>(cell.sequence.load(std::memory_order_acquire) - position);
+            if (difference == 0) {
+                if (_writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) {
+                _fullEvents.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else {
+                position = _writePosition.load(std::memory_order_relaxed);
+            }
+        }
+        slot.data = slotData(position);
+        slot.sequence = position;
+        return true;
+    }
+
+    WriteSlot acquireWrite()
+    {
+        WriteSlot slot;
+        for (int attempt = 0; !tryAcquireWrite(slot); attempt++) backOff(attempt);
+        return slot;
+    }
+
+    //publishes a written slot to consumers
+    void commit(const WriteSlot& slot)
+    {
+        Cell& cell = _cells[slot.sequence & _mask];
+        cell.committedAt = now();
+        cell.sequence.store(slot.sequence + 1, std::memory_order_release);
+    }
+
+    //acquires the oldest committed slot for reading, false if there is none
+    bool tryAcquireRead(ReadSlot& slot)
+    {
+        std::uint64_t position = _readPosition.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &_cells[position & _mask];
+            std::int64_t difference = static_cast<std::int64_t>(cell->sequence.load(std::memory_order_acquire) - (position + 1));
+            if (difference == 0) {
+                if (_readPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (difference < 0) {
+                _emptyEvents.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else {
+                position = _readPosition.load(std::memory_order_relaxed);
+            }
+        }
+        recordLatency(now() - cell->committedAt);
+        slot.data = slotData(position);
+        slot.sequence = position;
+        return true;
+    }
+
+    ReadSlot acquireRead()
+    {
+        ReadSlot slot;
+        for (int attempt = 0; !tryAcquireRead(slot); attempt++) backOff(attempt);
+        return slot;
+    }
+
+    //hands a read slot back to producers
+    void release(const ReadSlot& slot)
+    {
+        _cells[slot.sequence & _mask].sequence.store(slot.sequence + _capacity, std::memory_order_release);
+    }
+
+    LatencyStats getLatencyStats() const
+    {
+        LatencyStats stats;
+        std::array<std::uint64_t, histogramBuckets> histogram;
+        for (int b = 0; b < histogramBuckets; b++) {
+            histogram[b] = _histogram[b].load(std::memory_order_relaxed);
+            stats.count += histogram[b];
+        }
+        if (stats.count > 0) {
+            stats.meanNs = static_cast<double>(_latencySum.load(std::memory_order_relaxed)) / stats.count;
+            stats.maxNs = static_cast<double>(_latencyMax.load(std::memory_order_relaxed));
+            stats.p50Ns = percentile(histogram, stats.count, 0.5);
+            stats.p99Ns = percentile(histogram, stats.count, 0.99);
+        }
+        stats.fullEvents = _fullEvents.load(std::memory_order_relaxed);
+        stats.emptyEvents = _emptyEvents.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void resetLatencyStats()
+    {
+        for (auto& bucket : _histogram) bucket.store(0, std::memory_order_relaxed);
+        _latencySum.store(0, std::memory_order_relaxed);
+        _latencyMax.store(0, std::memory_order_relaxed);
+        _fullEvents.store(0, std::memory_order_relaxed);
+        _emptyEvents.store(0, std::memory_order_relaxed);
+    }
+
+    int getEnvSize() const { return _envsize; }
+    int getCapacity() const { return static_cast<int>(_capacity); }
+
+private:
+    static constexpr std::size_t cacheLine = 64;
+    static constexpr int histogramBuckets = 48;     // bucket b holds latencies in [2^(b-1), 2^b) ns
+
+    struct alignas(cacheLine) Cell {
+        std::atomic<std::uint64_t> sequence;
+        std::int64_t committedAt = 0;
+    };
+
+    int _envsize;
+    std::size_t _stride;    // floats between the starts of two slots
+    std::size_t _capacity;
+    std::size_t _mask;
+    float* _memory;
+    Cell* _cells;
+
+    alignas(cacheLine) std::atomic<std::uint64_t> _writePosition{ 0 };
+    alignas(cacheLine) std::atomic<std::uint64_t> _readPosition{ 0 };
+
+    alignas(cacheLine) std::array<std::atomic<std::uint64_t>, histogramBuckets> _histogram{};
+    std::atomic<std::uint64_t> _latencySum{ 0 };
+    std::atomic<std::uint64_t> _latencyMax{ 0 };
+    std::atomic<std::uint64_t> _fullEvents{ 0 };
+    std::atomic<std::uint64_t> _emptyEvents{ 0 };
+
+    static std::size_t strideOf(int envsize)
+    {
+        std::size_t floatsPerLine = cacheLine / sizeof(float);
+        return (static_cast<std::size_t>(envsize > 0 ? envsize : 1) + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+    }
+
+    static std::size_t roundUpToPowerOfTwo(int n)
+    {
+        std::size_t capacity = 2;
+        while (capacity < static_cast<std::size_t>(n)) capacity <<= 1;
+        return capacity;
+    }
+
+    static std::int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void backOff(int attempt)
+    {
+        if (attempt > 64) std::this_thread::yield();
+    }
+
+    float* slotData(std::uint64_t position) const { return _memory + (position & _mask) * _stride; }
+
+    void recordLatency(std::int64_t ns)
+    {
+        std::uint64_t latency = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+        int bucket = 0;
+        while (bucket < histogramBuckets - 1 && (latency >> bucket) != 0) bucket++;
+        _histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        _latencySum.fetch_add(latency, std::memory_order_relaxed);
+
+        std::uint64_t max = _latencyMax.load(std::memory_order_relaxed);
+        while (latency > max && !_latencyMax.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {}
+    }
+
+    static double percentile(const std::array<std::uint64_t, histogramBuckets>& histogram, std::uint64_t count, double q)
+    {
+        std::uint64_t target = static_cast<std::uint64_t>(q * count);
+        std::uint64_t cumulative = 0;
+        for (int b = 0; b < histogramBuckets; b++) {
+            cumulative += histogram[b];
+            if (cumulative > target) return static_cast<double>(std::uint64_t(1) << b);
+        }
+        return static_cast<double>(std::uint64_t(1) << (histogramBuckets - 1));
+    }
+};
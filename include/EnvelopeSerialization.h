@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Binary serialization of envelope tables, to persist them or send them to another process
+    through a file, a pipe or a socket stream.
+
+    A table message holds envsize, the peaks, the shapes and, when set, the shape positions on
+    the morph axis (setShapePositions). The shapes come in one of three encodings:
+    - Float32: the points as they are, lossless.
+    - Int16: points quantized to 16 bits against the largest absolute value of the table,
+      halving the size with an error below scale / 65534.
+    - Int16Delta: the Int16 values, each coded as its difference with the same point of the
+      previous shape, in zigzag varints. Neighbouring shapes of a table are usually similar, so
+      most points take a single byte.
+
+    A patch message carries a single shape, to be written over the same shape of a table
+    (replaceShape) without resending or reallocating the rest. The shape is overwritten in place
+    with no synchronization: when other threads render from the table, apply the patch to a copy
+    of it and publish the copy (for instance through an atomic pointer, freeing the old table once
+    no render can still be using it), rather than patching the table they read.
+
+    Values are written in the byte order of the host, that is little-endian on every platform
+    this is built for; the magic number makes readers of the other byte order reject them.
+    Reading functions return false, leaving the interpolator untouched, on malformed input.
+*/
+
+enum class SampleEncoding : std::uint8_t {
+    Float32,
+    Int16,
+    Int16Delta
+};
+
+bool writeEnvelopeTable(std::ostream& os, const EnvelopesInterpolator& et, SampleEncoding encoding = SampleEncoding::Float32);
+
+//replaces the whole table of et, envsize included
+bool readEnvelopeTable(std::istream& is, EnvelopesInterpolator& et);
+
+//Int16Delta is written as Int16: a patch is never coded against another shape
+bool writeShapePatch(std::ostream& os, const EnvelopesInterpolator& et, int shape, SampleEncoding encoding = SampleEncoding::Float32);
+
+//the patched shape must exist in et, with the same envsize; et must not be rendered from meanwhile
+bool applyShapePatch(std::istream& is, EnvelopesInterpolator& et);
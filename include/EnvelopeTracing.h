@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/*
+    Event tracing of the render pipeline, dumped in the Chrome trace JSON format (load it in
+    chrome://tracing or ui.perfetto.dev).
+
+    Instrumented code opens scopes with ENVELOPES_TRACE_SCOPE("name"): each scope records one
+    complete event (begin time and duration) into a ring buffer owned by the calling thread, so
+    recording takes no lock and threads never share a line. When a ring is full, the oldest
+    events are overwritten. The macro expands to nothing unless the library is built with
+    ENVELOPES_TRACING defined; when built in, tracing is still off until Tracer::setEnabled(true),
+    and a disabled scope costs one relaxed load.
+
+    Event names must be string literals, or otherwise outlive the dump. Dump once tracing is
+    disabled, or at least while the traced threads are idle: events being written during the
+    dump may come out torn.
+*/
+
+class Tracer
+{
+public:
+    static void setEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    //records a complete event of the calling thread, times in nanoseconds from now()
+    static void record(const char* name, std::int64_t begin, std::int64_t end);
+
+    static std::int64_t now();
+
+    //events of all threads, oldest first within each thread
+    static void writeChromeTrace(std::ostream& os);
+
+    //forgets all recorded events
+    static void clear();
+
+private:
+    static std::atomic<bool> _enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : _name(Tracer::enabled() ? name : nullptr), _begin(_name ? Tracer::now() : 0) {}
+
+    ~TraceScope()
+    {
+        if (_name != nullptr) Tracer::record(_name, _begin, Tracer::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* _name;
+    std::int64_t _begin;
+};
+
+#define ENVELOPES_TRACE_CONCAT_(a, b) a##b
+#define ENVELOPES_TRACE_CONCAT(a, b) ENVELOPES_TRACE_CONCAT_(a, b)
+
+#if defined(ENVELOPES_TRACING)
+#define ENVELOPES_TRACE_SCOPE(name) TraceScope ENVELOPES_TRACE_CONCAT(envelopesTraceScope, __LINE__)(name)
+#else
+#define ENVELOPES_TRACE_SCOPE(name) ((void)0)
+#endif
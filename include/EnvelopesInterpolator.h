@@ -1,8 +1,16 @@
 #pragma once
 
 #include <vector>
+#include <memory_resource>
 #include <algorithm>
 #include <cmath>
+#include <utility>
+#include <functional>
+#include "MorphKernel.h"
+#include "ShapeRasterizer.h"
+#include "RenderStats.h"
+#include "DeltaStream.h"
+#include "MemoryTracker.h"
 
 /*
     This class performs interpolation between a set of shapes, each defined by a set of points.
@@ -22,14 +30,25 @@ struct EnvelopeTable {
         const float* data;
         int envsize;
         int numberOfShapes;
-        std::vector<int> peaks;
+        std::pmr::vector<int> peaks;
 };
 
 class EnvelopesInterpolator
 {
 public:
-    EnvelopesInterpolator(int envsize);
-    EnvelopesInterpolator(EnvelopeTable e);
+    /**
+      * @param resource Memory resource used for the shapes, the peaks and any internal scratch.
+      */
+    EnvelopesInterpolator(int envsize, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    EnvelopesInterpolator(const EnvelopeTable& e, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    //instances are registered with MemoryTracker::global() for as long as they live. Move assignment
+    //may allocate, when the two instances use different memory resources
+    EnvelopesInterpolator(const EnvelopesInterpolator& other);
+    EnvelopesInterpolator(EnvelopesInterpolator&& other) noexcept;
+    EnvelopesInterpolator& operator=(const EnvelopesInterpolator& other);
+    EnvelopesInterpolator& operator=(EnvelopesInterpolator&& other);
+    ~EnvelopesInterpolator();
 
     /**
       * @brief Interpolates between two shapes based on a given factor.
@@ -37,27 +56,200 @@ public:
       * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
       * @param targetbuffer Target buffer to store the interpolated shape.
       */
-    void interpolate(float s, float* targetbuffer);
-    void interpolate(float s, std::vector<float>& targetbuffer);
+    void interpolate(float s, float* targetbuffer) const;
+    void interpolate(float s, std::vector<float>& targetbuffer) const;
+
+    /**
+      * @brief Interpolates and gathers statistics of the result (peak, sum, RMS, max slope) in the same pass.
+      *        When the call is rejected, stats is reset (count = 0), as with the other variants taking stats.
+      */
+    void interpolate(float s, float* targetbuffer, RenderStats& stats) const;
+
+    /**
+      * @brief Same result as interpolate, with a fixed amount of work per sample whatever s and the
+      *        peaks: no shortcut for integer s, a branch-free choice of side for every sample, and
+      *        custom shape positions bisected in a number of steps set by the number of shapes. The
+      *        addresses read still depend on s, so cache misses are not covered.
+      *        Never allocates, once the calling thread has called MetricsRegistry::registerThread.
+      *        Out-of-range s renders silence, at the same cost.
+      */
+    void interpolateConstantTime(float s, float* targetbuffer) const;
+
+    /**
+      * @brief Interpolates over the previous render held in targetbuffer, recording in delta the runs
+      *        of samples that changed, in the same pass. The runs replace those of the previous call.
+      */
+    void interpolate(float s, float* targetbuffer, DeltaStream& delta) const;
+
+    /**
+      * @brief Interpolates a portion of the shape only.
+      * 
+      * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
+      * @param start First index to render.
+      * @param count Number of samples to render (start + count ≤ _envsize).
+      * @param targetbuffer Target buffer of count samples.
+      */
+    void interpolateRange(float s, int start, int count, float* targetbuffer) const;
+
+    /**
+      * @brief Interpolates the whole shape in chunks of at most chunkSize samples, handed to a callback.
+      *        Memory used is bounded by chunkSize, regardless of _envsize.
+      * 
+      * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
+      * @param chunkSize Maximum number of samples per chunk.
+      * @param callback Called in order with (chunk, offset of its first sample, number of samples).
+      */
+    void interpolateChunked(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback) const;
+    void interpolateChunked(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback, RenderStats& stats) const;
+
+    /**
+      * @brief Interpolates between a shape and the next one, regardless of shape positions.
+      * 
+      * @param shape Index of the first shape.
+      * @param factor Interpolation factor towards the next shape (0.0 ≤ factor < 1.0).
+      * @param targetbuffer Target buffer to store the interpolated shape.
+      */
+    void interpolateBetween(int shape, float factor, float* targetbuffer) const;
+
+    /**
+      * @brief Blends K shapes at once: all of them are stretched to the weighted average of their peaks
+      *        and summed with the given weights, in a single pass over the output.
+      * 
+      * @param indices Indices of the shapes to blend.
+      * @param weights Non-negative weight of each shape; they are normalized to sum to 1.
+      * @param K Number of shapes (1 ≤ K ≤ maxBlendShapes).
+      * @param targetbuffer Target buffer to store the blended shape.
+      */
+    void interpolateWeighted(const int* indices, const float* weights, int K, float* targetbuffer) const;
+    void interpolateWeighted(const int* indices, const float* weights, int K, float* targetbuffer, RenderStats& stats) const;
+
+    /**
+      * @brief Renders a block following a morph automation lane, evaluating each sample directly.
+      * 
+      * @param keyframes (sample offset, s) pairs sorted by offset. s is linearly interpolated between
+      *                  keyframes and held before the first and after the last one.
+      * @param phase Envelope read position (in envelope samples) of the first sample of the block.
+      * @param increment Read position advance per output sample.
+      * @param targetbuffer Target buffer of numSamples samples.
+      * @return The read position following the block.
+      */
+    float renderAutomation(const std::vector<std::pair<int, float>>& keyframes, float phase, float increment, float* targetbuffer, int numSamples) const;
+
+    /**
+      * @brief Value of the interpolated shape at a single, possibly fractional, position. O(1).
+      * 
+      * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
+      * @param x Position in the envelope; positions outside [0, _envsize - 1] give zero.
+      */
+    float valueAt(float s, float x) const;
+
+    //peak position of the interpolated shape, -1 if s is out of range
+    float getGhostPeak(float s) const;
 
     void setDataAndPeaks(const float* data, const std::vector<int>& peaks);
-    void setEnvelopeTable(EnvelopeTable e);
+    void setEnvelopeTable(const EnvelopeTable& e);
     void addNewShape(const std::vector<float>& shape, int peakPosition);
     void addLinearShape(const std::vector<std::pair<int, float>>& points, int peakPosition);
 
+    /**
+      * @brief Adds many shapes drawn via linear interpolation, rasterized in parallel straight into the table.
+      *        Nothing is added if any of the shapes is invalid.
+      * 
+      * @param shapes Breakpoints of each shape, as for addLinearShape.
+      * @param peakPositions Peak position of each shape.
+      * @param threads Number of threads, 0 to pick one based on the amount of work.
+      */
+    void addLinearShapes(const std::vector<std::vector<std::pair<int, float>>>& shapes, const std::vector<int>& peakPositions, int threads = 0);
+    void addCurveShape(const std::vector<CurveSegment>& segments, int peakPosition);
+
+    //overwrite shape n in place, keeping its position on the morph axis. Nothing synchronizes this
+    //with renders: a thread interpolating meanwhile can read a half-written shape, so live tables
+    //are patched on a copy that is then swapped in
+    void replaceShape(int n, const float* shape, int peakPosition);
+
+    /**
+      * @brief Places each shape at a custom coordinate of the morph axis, instead of at its index.
+      *        s then ranges over [0, axisLength), wrapping from the last shape back to the first.
+      *        Positions are reset to the shape indices whenever shapes are added or the table replaced.
+      * 
+      * @param positions Strictly increasing coordinates, one per shape, within [0, axisLength).
+      * @param axisLength Length of the (circular) morph axis.
+      */
+    void setShapePositions(const std::vector<float>& positions, float axisLength);
+
+    //coordinates set with setShapePositions, empty when shapes sit at their index
+    const std::pmr::vector<float>& getShapePositions() const { return _positions; }
+
+    //range of s: [0, getAxisLength())
+    float getAxisLength() const { return _positions.empty() ? static_cast<float>(_numberOfShapes) : _axisLength; }
+
+    //s converted to shape index plus interpolation factor, -1 if s is out of range
+    float getShapeCoordinate(float s) const;
+
+    int getEnvSize() const { return _envsize; }
+    int getNumberOfShapes() const { return _numberOfShapes; }
+    const std::pmr::vector<int>& getPeaks() const { return _peaks; }
+    const float* getShape(int n) const { return shapeData(n); }
+
+    std::pmr::memory_resource* getMemoryResource() const { return _peaks.get_allocator().resource(); }
+
+    /**
+      * @brief Bytes currently allocated, by category. The interpolator keeps no caches nor scratch
+      *        buffers between calls (interpolateChunked allocates chunkSize samples for the duration
+      *        of the call); caches built on it, such as MorphLattice, are counted by MemoryTracker
+      *        on their own, under caches.
+      */
+    MemoryUsage memoryUsage() const;
+
 private:
-    std::vector<std::vector<float>> _shapes;
+    std::pmr::vector<float> _shapes;  // flat, _numberOfShapes * _envsize points
     int _numberOfShapes;
     int _envsize;
-    std::vector<int> _peaks;
+    std::pmr::vector<int> _peaks;
+
+    //custom shape positions on the morph axis; empty when shapes sit at their index
+    std::pmr::vector<float> _positions;
+    float _axisLength;
+    float _binScale;
+    std::pmr::vector<int> _positionIndex;  // per bin of the axis, last shape at or before the bin start
+
+    MemoryTracker::Entry _trackerEntry;
+
+    void resetShapePositions();
+
+    //reports the current memory usage to the global tracker, after any change to the table
+    void updateMemoryAccounting();
+
+    //the public variants forward here, stats being null when not requested
+    void interpolateImpl(float s, float* targetbuffer, RenderStats* stats) const;
+    void interpolateChunkedImpl(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback, RenderStats* stats) const;
+    void interpolateWeightedImpl(const int* indices, const float* weights, int K, float* targetbuffer, RenderStats* stats) const;
+
+    const float* shapeData(int n) const { return _shapes.data() + static_cast<size_t>(n) * _envsize; }
 
     /**
-     * @brief Stretches or shrinks a curve to match a specified length.
+     * @brief Finds the pair of shapes and the fractional factor for a given s.
      * 
-     * @param inputCurve The original curve to stretch or shrink.
-     * @param stretchedCurve Output vector to store the adjusted curve.
-     * @param newLength The virtual length of the stretched curve.
-	 * @param excludePeak If true, the last point of the curve is excluded from the output.
+     * @return false if s is out of range.
+     */
+    bool locate(float s, int& i1, int& i2, float& s_dec) const;
+
+    /**
+     * @brief Same pair and factor as locate, at a cost that depends on the table only: custom
+     *        positions are bisected rather than scanned from their bin. An out-of-range s gives
+     *        shape 0 with factor 0.
+     *
+     * @return false if s is out of range.
+     */
+    bool locateFixedCost(float s, int& i1, int& i2, float& s_dec) const;
+
+    /**
+     * @brief Morphed value at index x, given shape pair, factor and geometry of the ghost shape.
+     */
+    float morphSample(int i1, int i2, float s_dec, const MorphGeometry& g, int x) const;
+
+    /**
+     * @brief Writes indices [start, start + count) of the morph, given shape pair and factor.
      */
-	void stretchCurve(const std::vector<float>& inputCurve, std::vector<float>& stretchedCurve, float newLength, bool excludePeak = false);
+    void morphRange(int i1, int i2, float s_dec, int start, int count, float* targetbuffer) const;
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include "MorphKernel.h"
+#include "ShapeRasterizer.h"
+
+/*
+    Heap-free variant of EnvelopesInterpolator.
+
+    Shapes and peaks live in a memory block supplied by the caller at init time, sized for a
+    fixed maximum number of shapes (see requiredMemory). No operation allocates: the morph is
+    computed in a single pass and needs no scratch space. Operations that cannot be carried out
+    report why through an InterpolatorStatus instead of being silently ignored.
+*/
+
+enum class InterpolatorStatus {
+    Ok,
+    NotInitialized,
+    InvalidArgument,
+    InvalidShape,       // first or last point is not zero, or peak out of range
+    CapacityExceeded,
+    OutOfRange          // s outside [0, numberOfShapes)
+};
+
+class FixedEnvelopesInterpolator
+{
+public:
+    FixedEnvelopesInterpolator();
+
+    /**
+      * @brief Bytes needed by a memory block holding up to maxShapes shapes of envsize points.
+      */
+    static std::size_t requiredMemory(int envsize, int maxShapes);
+
+    /**
+      * @brief Binds the interpolator to a memory block. Any previous content is discarded.
+      *
+      * @param memory Memory block, owned by the caller, that must outlive the interpolator.
+      * @param bytes Size of the memory block, at least requiredMemory(envsize, maxShapes).
+      */
+    InterpolatorStatus init(void* memory, std::size_t bytes, int envsize, int maxShapes);
+
+    /**
+      * @brief Interpolates between two shapes based on a given factor.
+      *
+      * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
+      * @param targetbuffer Target buffer of _envsize samples.
+      */
+    InterpolatorStatus interpolate(float s, float* targetbuffer) const;
+    InterpolatorStatus interpolateRange(float s, int start, int count, float* targetbuffer) const;
+
+    //data is a one dimensional array of size numberOfShapes*envsize
+    InterpolatorStatus setDataAndPeaks(const float* data, const int* peaks, int numberOfShapes);
+    InterpolatorStatus addNewShape(const float* shape, int peakPosition);
+    InterpolatorStatus addLinearShape(const std::pair<int, float>* points, std::size_t numberOfPoints, int peakPosition);
+    void clear();
+
+    int getEnvSize() const { return _envsize; }
+    int getNumberOfShapes() const { return _numberOfShapes; }
+    int getCapacity() const { return _maxShapes; }
+
+private:
+    float* _data;
+    int* _peaks;
+    int _maxShapes;
+    int _numberOfShapes;
+    int _envsize;
+
+    bool isValidShape(const float* shape, int peakPosition) const;
+};
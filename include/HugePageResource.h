@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+/*
+    Memory resource backing large allocations with 2 MB pages, meant for the flat shape storage
+    of big banks (pass it to the EnvelopesInterpolator constructor).
+
+    Large allocations are first attempted from hugetlbfs (MAP_HUGETLB), which only succeeds if
+    huge pages have been reserved on the system; otherwise a 2 MB aligned anonymous mapping is
+    requested with madvise(MADV_HUGEPAGE), and whether transparent huge pages are actually used is
+    up to the kernel. Small allocations, and any allocation on systems without mmap, go to the
+    upstream resource.
+*/
+
+enum class PageBacking {
+    Regular,
+    TransparentHugePages,
+    HugeTLB
+};
+
+class HugePageResource : public std::pmr::memory_resource
+{
+public:
+    /**
+      * @param minimumSize Allocations smaller than this go to the upstream resource.
+      * @param tryHugeTLB Attempt hugetlbfs before transparent huge pages.
+      */
+    HugePageResource(std::size_t minimumSize = hugePageSize / 2, bool tryHugeTLB = true,
+                     std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    //backing requested for the last large allocation
+    PageBacking requestedBacking() const { return _requestedBacking; }
+
+    /**
+      * @brief Backing actually obtained by the mapping containing p, as reported by the kernel.
+      *        Transparent huge pages are only assigned once memory is touched, so query after
+      *        filling the table.
+      */
+    static PageBacking queryBacking(const void* p);
+
+    static const char* backingName(PageBacking backing);
+
+private:
+    std::size_t _minimumSize;
+    bool _tryHugeTLB;
+    std::pmr::memory_resource* _upstream;
+    PageBacking _requestedBacking;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+};
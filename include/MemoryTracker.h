@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+class EnvelopesInterpolator;
+
+/*
+    Bytes held by an interpolator, by category. Sizes are those of the allocations (vector
+    capacities), which is what the memory resource actually handed out.
+*/
+struct MemoryUsage {
+    std::size_t tableData = 0;  // shape points
+    std::size_t perShape = 0;   // peaks, shape positions and their index
+    std::size_t caches = 0;     // derived data kept between calls, and caches built on interpolators
+    std::size_t scratch = 0;    // working buffers kept between calls
+    std::size_t object = 0;     // the interpolator object itself
+
+    std::size_t total() const { return tableData + perShape + caches + scratch + object; }
+
+    MemoryUsage& operator+=(const MemoryUsage& other)
+    {
+        tableData += other.tableData;
+        perShape += other.perShape;
+        caches += other.caches;
+        scratch += other.scratch;
+        object += other.object;
+        return *this;
+    }
+};
+
+/*
+    Memory of all live interpolators of the process, and of the caches built on them.
+
+    Interpolators register themselves on construction (copies and moves included) and report
+    their usage whenever their table changes, so the totals are always current without ever
+    touching the interpolators themselves: they can be read from any thread while others render
+    or load tables. A budget can be set for services to check before loading more, or to pick
+    instances to evict from forEachInstance.
+
+    Each tracked object embeds the Entry linking it into the tracker, so registering never
+    allocates: a move constructor can register its new object and stay noexcept.
+*/
+class MemoryTracker
+{
+public:
+    class Entry
+    {
+    public:
+        Entry() = default;
+
+        //an entry belongs to the object embedding it: copies start unregistered
+        Entry(const Entry&) {}
+        Entry& operator=(const Entry&) { return *this; }
+
+    private:
+        friend class MemoryTracker;
+
+        const EnvelopesInterpolator* _instance = nullptr;
+        MemoryUsage _usage;
+        Entry* _previous = nullptr;
+        Entry* _next = nullptr;
+        bool _registered = false;
+    };
+
+    static MemoryTracker& global();
+
+    MemoryUsage total() const;
+    std::size_t liveInstances() const;
+
+    //calls f with each live instance and its last reported usage, holding the tracker lock: f must not
+    //create, destroy or modify interpolators
+    void forEachInstance(const std::function<void(const EnvelopesInterpolator&, const MemoryUsage&)>& f) const;
+
+    //0 for no budget
+    void setBudget(std::size_t bytes);
+    std::size_t getBudget() const;
+    bool overBudget() const;
+
+    //called by EnvelopesInterpolator and TrackedCacheMemory with the entry they embed, registering it
+    //on the first update; instance is null for caches
+    void update(Entry& entry, const EnvelopesInterpolator* instance, const MemoryUsage& usage);
+    void remove(Entry& entry);
+
+private:
+    MemoryTracker() = default;
+
+    mutable std::mutex _mutex;
+    Entry* _first = nullptr;
+    std::size_t _liveInstances = 0;
+    MemoryUsage _total;
+    std::size_t _budget = 0;
+};
+
+/*
+    Memory of a cache built on an interpolator (MorphLattice, AdaptiveMorphLattice, EnvelopeOverview),
+    counted by the global tracker under caches for as long as the cache lives. The cache embeds it
+    and reports its size with set(); copies and moves of the cache carry the size along.
+*/
+class TrackedCacheMemory
+{
+public:
+    TrackedCacheMemory() = default;
+    TrackedCacheMemory(const TrackedCacheMemory& other);
+    TrackedCacheMemory(TrackedCacheMemory&& other) noexcept;
+    TrackedCacheMemory& operator=(const TrackedCacheMemory& other);
+    TrackedCacheMemory& operator=(TrackedCacheMemory&& other);
+    ~TrackedCacheMemory();
+
+    void set(std::size_t bytes);
+
+private:
+    MemoryTracker::Entry _entry;
+    std::size_t _bytes = 0;
+};
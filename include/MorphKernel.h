@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+/*
+    Per-sample form of the peak-aligned stretch performed by EnvelopesInterpolator.
+
+    A shape is split at its peak: the left part (peak included) is stretched over
+    [0, ghost peak], the right part over [ghost peak, envsize - 1], measured backwards
+    from the end of the envelope. Since the mapping from output index to source position
+    is known in closed form, any output sample can be evaluated on its own, without
+    materializing the stretched curves.
+*/
+
+struct MorphGeometry {
+    int envsize;
+    float ghost_peak_xpos;
+    float xspan_L;
+    float xspan_R;
+    int split;  // first output index belonging to the right part
+};
+
+constexpr MorphGeometry makeMorphGeometry(float ghost_peak_xpos, int envsize)
+{
+    MorphGeometry g{};
+    g.envsize = envsize;
+    g.ghost_peak_xpos = ghost_peak_xpos;
+    g.xspan_L = ghost_peak_xpos + 1;
+    g.xspan_R = envsize - ghost_peak_xpos;
+    g.split = static_cast<int>(g.xspan_L);
+    return g;
+}
+
+//source positions per output step for the left and right parts of a shape
+constexpr double leftRatio(int peak, const MorphGeometry& g)
+{
+    return (g.xspan_L > 1) ? peak / (static_cast<double>(g.xspan_L) - 1) : 0.0;
+}
+
+constexpr double rightRatio(int peak, const MorphGeometry& g)
+{
+    return (g.xspan_R > 1) ? (g.envsize - peak - 1) / (static_cast<double>(g.xspan_R) - 1) : 0.0;
+}
+
+constexpr float leftSample(const float* shape, int peak, double ratio, int x)
+{
+    double originalX = x * ratio;
+
+    int x0 = static_cast<int>(originalX);
+    int x1 = std::min(x0 + 1, peak);
+
+    float t = static_cast<float>(originalX - x0);
+    return shape[x0] + t * (shape[x1] - shape[x0]);
+}
+
+//the right part is stretched from the end of the envelope backwards
+constexpr float rightSample(const float* shape, int peak, int envsize, double ratio, int x)
+{
+    double originalX = (envsize - 1 - x) * ratio;
+
+    int x0 = static_cast<int>(originalX);
+    int x1 = std::min(x0 + 1, envsize - peak - 1);
+
+    float y0 = shape[envsize - 1 - x0];
+    float y1 = shape[envsize - 1 - x1];
+
+    float t = static_cast<float>(originalX - x0);
+    return y0 + t * (y1 - y0);
+}
+
+/**
+ * @brief Value at output index x of a shape stretched so that its peak lands on the ghost peak.
+ *
+ * @param shape The shape samples (envsize points).
+ * @param peak Peak position of the shape.
+ * @param g Geometry of the target (ghost) shape.
+ * @param x Output index, 0 ≤ x < envsize.
+ */
+constexpr float stretchedSample(const float* shape, int peak, const MorphGeometry& g, int x)
+{
+    if (x < g.split) return leftSample(shape, peak, leftRatio(peak, g), x);
+    return rightSample(shape, peak, g.envsize, rightRatio(peak, g), x);
+}
+
+/**
+ * @brief Writes output indices [start, start + count) of the morph between shapes A and B.
+ *
+ * @param s_dec Interpolation factor between A (0) and B (1).
+ * @param out Output buffer of count samples; out[0] corresponds to index start.
+ */
+constexpr void morphShapesRange(const float* shapeA, int peakA, const float* shapeB, int peakB, float s_dec,
+                                const MorphGeometry& g, int start, int count, float* out)
+{
+    int end = start + count;
+    int mid = std::min(std::max(g.split, start), end);
+
+    double ratioA = leftRatio(peakA, g);
+    double ratioB = leftRatio(peakB, g);
+    for (int x = start; x < mid; x++) {
+        float a = leftSample(shapeA, peakA, ratioA, x);
+        float b = leftSample(shapeB, peakB, ratioB, x);
+        out[x - start] = (1 - s_dec) * a + s_dec * b;
+    }
+
+    ratioA = rightRatio(peakA, g);
+    ratioB = rightRatio(peakB, g);
+    for (int x = mid; x < end; x++) {
+        float a = rightSample(shapeA, peakA, g.envsize, ratioA, x);
+        float b = rightSample(shapeB, peakB, g.envsize, ratioB, x);
+        out[x - start] = (1 - s_dec) * a + s_dec * b;
+    }
+}
+
+//one part of a stretched shape, in a form shared by both parts: source index i is read at
+//origin[stride * i], stride being 1 for the left part and -1 for the right one, up to limit
+struct StretchSide {
+    const float* origin;
+    double ratio;
+    int limit;
+};
+
+constexpr StretchSide leftSide(const float* shape, int peak, const MorphGeometry& g)
+{
+    return { shape, leftRatio(peak, g), peak };
+}
+
+constexpr StretchSide rightSide(const float* shape, int peak, const MorphGeometry& g)
+{
+    return { shape + g.envsize - 1, rightRatio(peak, g), g.envsize - peak - 1 };
+}
+
+//leftSample or rightSample, position being x or envsize - 1 - x
+constexpr float sideSample(const StretchSide& side, std::ptrdiff_t stride, double position)
+{
+    //the fields are read once: a std::min against a field in memory compiles to a branch
+    const float* origin = side.origin;
+    int limit = side.limit;
+    double originalX = position * side.ratio;
+
+    int x0 = static_cast<int>(originalX);
+    int x1 = std::min(x0 + 1, limit);
+
+    float y0 = origin[stride * x0];
+    float y1 = origin[stride * x1];
+
+    float t = static_cast<float>(originalX - x0);
+    return y0 + t * (y1 - y0);
+}
+
+/**
+ * @brief Same result as morphShapesRange, with a per-sample loop that does not branch on the shapes,
+ *        the peaks or s: each output sample selects the part it belongs to (origin, stride, ratio
+ *        and limit) arithmetically, then reads two source points of each shape, as morphShapesRange
+ *        does. The work per sample is therefore fixed; the addresses read still depend on the peaks
+ *        and s, as for any stretch, so cache effects are not covered.
+ */
+constexpr void constantTimeMorphRange(const float* shapeA, int peakA, const float* shapeB, int peakB, float s_dec,
+                                      const MorphGeometry& g, int start, int count, float* out)
+{
+    //indexed by isLeft rather than branched on
+    const StretchSide sidesA[2] = { rightSide(shapeA, peakA, g), leftSide(shapeA, peakA, g) };
+    const StretchSide sidesB[2] = { rightSide(shapeB, peakB, g), leftSide(shapeB, peakB, g) };
+
+    for (int x = start; x < start + count; x++) {
+        int isLeft = x < g.split;
+        std::ptrdiff_t stride = 2 * isLeft - 1;
+
+        //x on the left, envsize - 1 - x on the right: written as a select, it compiles to a branch
+        int position = x + ((g.envsize - 1 - 2 * x) & (isLeft - 1));
+
+        float a = sideSample(sidesA[isLeft], stride, position);
+        float b = sideSample(sidesB[isLeft], stride, position);
+        out[x - start] = (1 - s_dec) * a + s_dec * b;
+    }
+}
+
+//maximum number of shapes blended by weightedMorphRange
+constexpr int maxBlendShapes = 16;
+
+/**
+ * @brief Writes output indices [start, start + count) of a weighted blend of K shapes, all stretched
+ *        to the same ghost peak (the weighted average of their peaks, see g).
+ *
+ * @param shapes The K shapes.
+ * @param peaks Peak position of each shape.
+ * @param weights Weight of each shape, summing to 1.
+ * @param K Number of shapes, at most maxBlendShapes.
+ * @param out Output buffer of count samples; out[0] corresponds to index start.
+ */
+constexpr void weightedMorphRange(const float* const* shapes, const int* peaks, const float* weights, int K,
+                                  const MorphGeometry& g, int start, int count, float* out)
+{
+    int end = start + count;
+    int mid = std::min(std::max(g.split, start), end);
+
+    double ratios[maxBlendShapes] = {};
+
+    for (int k = 0; k < K; k++) ratios[k] = leftRatio(peaks[k], g);
+    for (int x = start; x < mid; x++) {
+        float sum = 0;
+        for (int k = 0; k < K; k++) sum += weights[k] * leftSample(shapes[k], peaks[k], ratios[k], x);
+        out[x - start] = sum;
+    }
+
+    for (int k = 0; k < K; k++) ratios[k] = rightRatio(peaks[k], g);
+    for (int x = mid; x < end; x++) {
+        float sum = 0;
+        for (int k = 0; k < K; k++) sum += weights[k] * rightSample(shapes[k], peaks[k], g.envsize, ratios[k], x);
+        out[x - start] = sum;
+    }
+}
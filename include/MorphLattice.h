@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Precomputed morphs for audio-rate modulation of s.
+
+    For every pair of neighbouring shapes, framesPerPair morphs are rendered at load time, at
+    evenly spaced values of s. A lookup is then a bilinear read in (x, s) between the four
+    surrounding lattice points: O(1) and independent of the cost of the exact algorithm.
+    Between frames the result is a plain cross-fade, so the peak no longer moves continuously;
+    maxError() reports how far that is from the exact interpolation, to size framesPerPair
+    against memory (memoryBytes, estimateMemory). Lattices count in MemoryTracker::global(),
+    under caches.
+
+    Lattices are indexed by shape index plus interpolation factor: with custom shape positions,
+    convert s with EnvelopesInterpolator::getShapeCoordinate first.
+*/
+
+class MorphLattice
+{
+public:
+    /**
+      * @param et Interpolator providing shapes and exact morphs; only used during construction.
+      * @param framesPerPair Frames rendered between each shape and the next (≥ 1).
+      * @param measureError Measure the maximum error at build time, costing one more render per frame.
+      */
+    MorphLattice(const EnvelopesInterpolator& et, int framesPerPair, bool measureError = true);
+
+    /**
+      * @brief Bilinear lookup of the morph.
+      *
+      * @param s Interpolation factor (0.0 ≤ s ≤ numberOfShapes).
+      * @param x Position in the envelope; positions outside [0, envsize - 1] give zero.
+      */
+    float valueAt(float s, float x) const;
+
+    /**
+      * @brief Whole morph for a given s, cross-faded between the two nearest frames.
+      */
+    void interpolate(float s, float* targetbuffer) const;
+
+    //maximum absolute difference with the exact algorithm, measured halfway between frames
+    float maxError() const { return _maxError; }
+
+    std::size_t memoryBytes() const { return _frames.size() * sizeof(float); }
+    static std::size_t estimateMemory(int envsize, int numberOfShapes, int framesPerPair);
+
+    int getFramesPerPair() const { return _framesPerPair; }
+
+private:
+    int _envsize;
+    int _numberOfShapes;
+    int _framesPerPair;
+    float _maxError;
+
+    //numberOfShapes * framesPerPair frames of envsize points; frame f is the morph at s = f / framesPerPair
+    std::vector<float> _frames;
+    TrackedCacheMemory _trackedMemory;
+
+    //finds the two frames around s and the cross-fade factor between them
+    bool locate(float s, const float*& frameA, const float*& frameB, float& t) const;
+};
+
+/*
+    Morph lattice with frames placed where they are needed.
+
+    Each pair of shapes starts with its two end frames; an interval of s is split in two for as
+    long as the cross-fade at its midpoint differs from the exact morph by more than the
+    tolerance. Nearly identical pairs thus keep a single frame, while pairs whose peaks are far
+    apart get as many as required. Lookups find the interval with a binary search over the
+    breakpoints of the pair: O(log k) for k frames.
+*/
+
+class AdaptiveMorphLattice
+{
+public:
+    /**
+      * @param et Interpolator providing shapes and exact morphs; only used during construction.
+      * @param tolerance Maximum absolute error accepted at the midpoint of an interval.
+      * @param maxDepth Maximum number of subdivisions, bounding the number of frames per pair to 2^maxDepth.
+      */
+    AdaptiveMorphLattice(const EnvelopesInterpolator& et, float tolerance, int maxDepth = 12);
+
+    float valueAt(float s, float x) const;
+    void interpolate(float s, float* targetbuffer) const;
+
+    //maximum absolute difference with the exact algorithm, measured at the midpoints of the final intervals
+    float maxError() const { return _maxError; }
+
+    std::size_t memoryBytes() const;
+    int numberOfFrames() const { return static_cast<int>(_breakpoints.size()); }
+    int framesOfPair(int pair) const { return _pairOffset[pair + 1] - _pairOffset[pair]; }
+
+private:
+    int _envsize;
+    int _numberOfShapes;
+    float _tolerance;
+    int _maxDepth;
+    float _maxError;
+
+    //frames of all pairs, in order; frames of pair i are [_pairOffset[i], _pairOffset[i + 1]),
+    //_breakpoints holding their position in [0, 1) within the pair
+    std::vector<float> _frames;
+    std::vector<float> _breakpoints;
+    std::vector<int> _pairOffset;
+    TrackedCacheMemory _trackedMemory;
+
+    //appends the frames needed strictly between a and b, in order
+    void subdivide(const EnvelopesInterpolator& et, int pair, float a, const std::vector<float>& frameA, float b, const std::vector<float>& frameB, int depth);
+    bool locate(float s, const float*& frameA, const float*& frameB, float& t) const;
+};
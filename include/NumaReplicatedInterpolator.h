@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+
+/*
+    Keeps one read-only copy of an envelope table per NUMA node, so that render threads read
+    shapes from local memory instead of crossing the socket interconnect.
+
+    Each replica is built by a thread pinned to the CPUs of its node: with the default first-touch
+    policy, its pages are then allocated on that node. Calls are forwarded to the replica of the
+    node the calling thread runs on.
+
+    The topology can be simulated (any number of nodes, caller-defined node of the current thread),
+    which allows exercising replica selection on a single-node machine.
+*/
+
+struct NumaTopology {
+    int numberOfNodes = 1;
+
+    //CPUs of each node, used to place replicas; empty lists disable pinning
+    std::vector<std::vector<int>> cpusOfNode;
+
+    //node of the calling thread
+    std::function<int()> currentNode;
+
+    /**
+      * @brief Topology of the running machine, read from /sys/devices/system/node.
+      *        Falls back to a single node when it is not available.
+      */
+    static NumaTopology detect();
+
+    /**
+      * @brief Topology with numberOfNodes nodes, no pinning, and currentNode deciding the node of a thread.
+      */
+    static NumaTopology simulated(int numberOfNodes, std::function<int()> currentNode);
+};
+
+class NumaReplicatedInterpolator
+{
+public:
+    NumaReplicatedInterpolator(const EnvelopeTable& e, NumaTopology topology = NumaTopology::detect());
+
+    /**
+      * @brief Interpolates using the replica local to the calling thread.
+      *
+      * @param s Interpolation factor (0.0 ≤ s ≤ _numberOfShapes).
+      * @param targetbuffer Target buffer to store the interpolated shape.
+      */
+    void interpolate(float s, float* targetbuffer);
+
+    /**
+      * @brief Replaces the table of all replicas. Not safe while other threads are interpolating.
+      */
+    void setEnvelopeTable(const EnvelopeTable& e);
+
+    EnvelopesInterpolator& local();
+    EnvelopesInterpolator& replica(int node) { return *_replicas[node]; }
+    int numberOfReplicas() const { return static_cast<int>(_replicas.size()); }
+    int localNode() const;
+
+private:
+    NumaTopology _topology;
+    std::vector<std::unique_ptr<EnvelopesInterpolator>> _replicas;
+
+    //runs job on a thread pinned to the CPUs of the given node
+    void runOnNode(int node, const std::function<void()>& job);
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+/*
+    Statistics of a rendered envelope, gathered while it is being written.
+*/
+
+struct RenderStats {
+    float peak = 0;         // largest value
+    int peakIndex = 0;
+    float sum = 0;          // sum of all values, e.g. for area normalization
+    float rms = 0;
+    float maxSlope = 0;     // largest absolute difference between consecutive samples
+    int maxSlopeIndex = 0;  // index of the second sample of that difference
+    int count = 0;          // number of samples
+};
+
+/*
+    Accumulates RenderStats over consecutive blocks of an envelope. Blocks are meant to be added
+    right after being rendered, while still in cache, so that no extra pass over memory is needed.
+
+    Samples are dealt round-robin to eight lanes keeping maximums and partial sums, without any
+    branch, so that the lanes vectorize. Tracking the index of each maximum would cost a select per
+    sample: instead, the accumulator remembers the block holding each maximum and searches it once,
+    in result(). Blocks must therefore stay readable until then, or until settle() is called by
+    callers reusing a buffer for each block.
+*/
+class RenderStatsAccumulator
+{
+public:
+    //block holds the count samples starting at index start, following the previous block
+    void add(const float* block, int start, int count)
+    {
+        if (count <= 0) return;
+
+        //the slope of the very first sample is 0, it has no predecessor
+        float previous = (_count == 0) ? block[0] : _previous;
+
+        //the samples preceding the first four, the others are read from the block
+        float first[lanes] = { previous };
+        for (int k = 1; k < lanes && k < count; k++) first[k] = block[k - 1];
+
+        //two sets of lanes, eight samples per step, to overlap the latencies of the reductions
+        float peak[2][lanes], slope[2][lanes], sum[2][lanes], squares[2][lanes];
+        for (int set = 0; set < 2; set++) {
+            for (int k = 0; k < lanes; k++) {
+                peak[set][k] = -HUGE_VALF;
+                slope[set][k] = -HUGE_VALF;
+                sum[set][k] = 0;
+                squares[set][k] = 0;
+            }
+        }
+
+        int i = 0;
+        while (i + 2 * lanes <= count) {
+            //partial sums stay in float for sumBlockSize samples at most
+            int end = std::min(count, i + sumBlockSize) - 2 * lanes;
+            for (; i <= end; i += 2 * lanes) {
+                const float* before = (i > 0) ? block + i - 1 : first;
+                for (int k = 0; k < lanes; k++) {
+                    float y = block[i + k];
+                    peak[0][k] = std::max(peak[0][k], y);
+                    slope[0][k] = std::max(slope[0][k], std::fabs(y - before[k]));
+                    sum[0][k] += y;
+                    squares[0][k] += y * y;
+                }
+                for (int k = 0; k < lanes; k++) {
+                    float y = block[i + lanes + k];
+                    peak[1][k] = std::max(peak[1][k], y);
+                    slope[1][k] = std::max(slope[1][k], std::fabs(y - block[i + lanes + k - 1]));
+                    sum[1][k] += y;
+                    squares[1][k] += y * y;
+                }
+            }
+            foldSums(sum, squares);
+        }
+        for (int k = 0; i < count; i++, k++) {
+            float y = block[i];
+            int set = k / lanes, lane = k % lanes;
+            peak[set][lane] = std::max(peak[set][lane], y);
+            slope[set][lane] = std::max(slope[set][lane], std::fabs(y - (i > 0 ? block[i - 1] : previous)));
+            sum[set][lane] += y;
+            squares[set][lane] += y * y;
+        }
+        foldSums(sum, squares);
+
+        //a block only takes over a maximum it exceeds, so that the first occurrence wins
+        float blockPeak = -HUGE_VALF, blockSlope = -HUGE_VALF;
+        for (int set = 0; set < 2; set++) {
+            for (int k = 0; k < lanes; k++) {
+                blockPeak = std::max(blockPeak, peak[set][k]);
+                blockSlope = std::max(blockSlope, slope[set][k]);
+            }
+        }
+        if (_count == 0 || blockPeak > _peak.value) _peak = { blockPeak, block, start, count, previous };
+        if (_count == 0 || blockSlope > _slope.value) _slope = { blockSlope, block, start, count, previous };
+
+        _previous = block[count - 1];
+        _count += count;
+    }
+
+    //finds the indices of the maximums so far, after which the blocks added may be overwritten
+    void settle()
+    {
+        _peak.index = peakIndex();
+        _peak.block = nullptr;
+        _slope.index = slopeIndex();
+        _slope.block = nullptr;
+    }
+
+    RenderStats result() const
+    {
+        RenderStats stats;
+        if (_count == 0) return stats;
+
+        stats.peak = _peak.value;
+        stats.peakIndex = peakIndex();
+        stats.sum = static_cast<float>(_sum);
+        stats.rms = static_cast<float>(std::sqrt(_sumOfSquares / _count));
+        stats.maxSlope = _slope.value;
+        stats.maxSlopeIndex = slopeIndex();
+        stats.count = _count;
+        return stats;
+    }
+
+private:
+    static constexpr int lanes = 4;
+
+    //samples summed in float before being added to the double totals
+    static constexpr int sumBlockSize = 256;
+
+    //a maximum, with the block it was found in until its index is searched for
+    struct Maximum {
+        float value = 0;
+        const float* block = nullptr;
+        int start = 0;
+        int count = 0;
+        float previous = 0;  // sample preceding the block
+        int index = 0;       // once the block is gone
+    };
+
+    void foldSums(float (*sum)[lanes], float (*squares)[lanes])
+    {
+        for (int set = 0; set < 2; set++) {
+            for (int k = 0; k < lanes; k++) {
+                _sum += sum[set][k];
+                _sumOfSquares += squares[set][k];
+                sum[set][k] = 0;
+                squares[set][k] = 0;
+            }
+        }
+    }
+
+    int peakIndex() const
+    {
+        if (_peak.block == nullptr) return _peak.index;
+        for (int i = 0; i < _peak.count; i++) {
+            if (_peak.block[i] == _peak.value) return _peak.start + i;
+        }
+        return _peak.start;
+    }
+
+    int slopeIndex() const
+    {
+        if (_slope.block == nullptr) return _slope.index;
+        for (int i = 0; i < _slope.count; i++) {
+            float before = (i > 0) ? _slope.block[i - 1] : _slope.previous;
+            if (std::fabs(_slope.block[i] - before) == _slope.value) return _slope.start + i;
+        }
+        return _slope.start;
+    }
+
+    Maximum _peak;
+    Maximum _slope;
+    double _sum = 0;
+    double _sumOfSquares = 0;
+    float _previous = 0;
+    int _count = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+/*
+    Helpers turning breakpoint descriptions into shapes.
+    They only write into caller-provided storage; the linear ones are constexpr, so that tables
+    can be generated at compile time as well as at runtime.
+*/
+
+/**
+ * @brief Draws a shape via linear interpolation between breakpoints.
+ *
+ * @param points Breakpoints (x, y), sorted by x; the first x must be 0 and the last envsize - 1.
+ * @param numberOfPoints Number of breakpoints.
+ * @param envsize Number of points of the shape.
+ * @param shape Output buffer of envsize points.
+ */
+constexpr void rasterizeLinearShape(const std::pair<int, float>* points, std::size_t numberOfPoints, int envsize, float* shape)
+{
+    for (std::size_t i = 0; i + 1 < numberOfPoints; ++i) {
+        int x0 = points[i].first;
+        float y0 = points[i].second;
+        int x1 = std::min(points[i + 1].first, envsize - 1);
+        float y1 = points[i + 1].second;
+
+        //one division per segment; the fill has no loop-carried dependency. It is written four
+        //samples at a time so that it vectorizes at -O2 too, where GCC's cost model leaves plain
+        //loops of unknown trip count scalar
+        float slope = (x1 > x0) ? (y1 - y0) / (x1 - x0) : 0.0f;
+        int x = x0;
+        for (; x + 4 <= x1; x += 4) {
+            //same int type as x - x0 in the tail loop, so every sample rounds the same way
+            int offset = x - x0;
+            shape[x] = y0 + offset * slope;
+            shape[x + 1] = y0 + (offset + 1) * slope;
+            shape[x + 2] = y0 + (offset + 2) * slope;
+            shape[x + 3] = y0 + (offset + 3) * slope;
+        }
+        for (; x < x1; ++x) {
+            shape[x] = y0 + (x - x0) * slope;
+        }
+        if (x1 >= x0) shape[x1] = y1;
+    }
+}
+
+//position of the (first) maximum of a shape
+constexpr int findPeak(const float* shape, int envsize)
+{
+    int peak = 0;
+    for (int x = 1; x < envsize; ++x) {
+        if (shape[x] > shape[peak]) peak = x;
+    }
+    return peak;
+}
+
+enum class SegmentType {
+    Linear,
+    QuadraticBezier,
+    CubicBezier,
+    Exponential
+};
+
+/*
+    Curved segment, going from the end of the previous segment (or from (0, 0) for the first one)
+    to (x, y).
+    Bezier control points are evenly spaced in x, so c1 (and c2 for cubic segments) are the values
+    of the control points. For exponential segments c1 is the curvature: positive values rise fast
+    and settle, negative values start slow, 0 is a straight line.
+*/
+struct CurveSegment {
+    int x;
+    float y;
+    SegmentType type = SegmentType::Linear;
+    float c1 = 0;
+    float c2 = 0;
+};
+
+/**
+ * @brief Draws a shape made of curved segments.
+ *        Polynomial segments are evaluated with forward differences, exponential ones with a
+ *        running product, so that no per-sample division or transcendental call is needed.
+ *
+ * @param segments Segments, sorted by x; the last one must end at envsize - 1.
+ * @param numberOfSegments Number of segments.
+ * @param envsize Number of points of the shape.
+ * @param shape Output buffer of envsize points.
+ */
+inline void rasterizeCurveShape(const CurveSegment* segments, std::size_t numberOfSegments, int envsize, float* shape)
+{
+    int x0 = 0;
+    float y0 = 0;
+    shape[0] = 0;
+
+    for (std::size_t i = 0; i < numberOfSegments; ++i) {
+        const CurveSegment& segment = segments[i];
+        int x1 = std::min(segment.x, envsize - 1);
+        float y1 = segment.y;
+        int steps = x1 - x0;
+
+        if (steps > 0) {
+            double h = 1.0 / steps;
+
+            if (segment.type == SegmentType::Exponential && segment.c1 != 0) {
+                //y0 + (y1 - y0) * (1 - e^(-k t)) / (1 - e^(-k))
+                double k = segment.c1;
+                double scale = (y1 - y0) / (1 - std::exp(-k));
+                double decay = std::exp(-k * h);
+                double e = 1;
+                for (int x = x0; x < x1; ++x) {
+                    shape[x] = static_cast<float>(y0 + scale * (1 - e));
+                    e *= decay;
+                }
+            }
+            else {
+                //power basis a t^3 + b t^2 + c t + d of the segment
+                double a = 0, b = 0, c = y1 - y0;
+                if (segment.type == SegmentType::QuadraticBezier) {
+                    b = y0 - 2.0 * segment.c1 + y1;
+                    c = 2.0 * (segment.c1 - y0);
+                }
+                else if (segment.type == SegmentType::CubicBezier) {
+                    a = -y0 + 3.0 * segment.c1 - 3.0 * segment.c2 + y1;
+                    b = 3.0 * y0 - 6.0 * segment.c1 + 3.0 * segment.c2;
+                    c = 3.0 * (segment.c1 - y0);
+                }
+
+                //forward differences for a uniform step h
+                double y = y0;
+                double d1 = a * h * h * h + b * h * h + c * h;
+                double d2 = 6 * a * h * h * h + 2 * b * h * h;
+                double d3 = 6 * a * h * h * h;
+                for (int x = x0; x < x1; ++x) {
+                    shape[x] = static_cast<float>(y);
+                    y += d1;
+                    d1 += d2;
+                    d2 += d3;
+                }
+            }
+        }
+
+        //segment ends are exact
+        shape[x1] = y1;
+        x0 = x1;
+        y0 = y1;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include "MorphKernel.h"
+#include "ShapeRasterizer.h"
+
+/*
+    Compile-time counterpart of EnvelopeTable, and an interpolator reading straight from it.
+
+    A StaticEnvelopeTable can be built as a constexpr object from breakpoint lists, so the
+    whole table ends up in read-only memory; StaticEnvelopesInterpolator only keeps a reference
+    to it and never allocates.
+
+        constexpr std::array<std::pair<int, float>, 3> up = {{ {0, 0.0f}, {1, 1.0f}, {99, 0.0f} }};
+        constexpr std::array<std::pair<int, float>, 3> down = {{ {0, 0.0f}, {98, 1.0f}, {99, 0.0f} }};
+        static constexpr auto table = makeStaticEnvelopeTable<100>(up, down);
+        StaticEnvelopesInterpolator<100, 2> interpolator(table);
+*/
+
+template <int EnvSize, int NumberOfShapes>
+struct StaticEnvelopeTable {
+    std::array<float, EnvSize * NumberOfShapes> data;
+    std::array<int, NumberOfShapes> peaks;
+};
+
+//throws on breakpoints that do not describe a valid shape; in a constant expression, the
+//throw makes the table fail to compile
+template <int EnvSize, std::size_t N>
+constexpr void checkStaticBreakpoints(const std::array<std::pair<int, float>, N>& points)
+{
+    if (N < 2 || points[0].first != 0 || points[N - 1].first != EnvSize - 1) {
+        throw std::invalid_argument("breakpoints must start at x = 0 and end at x = EnvSize - 1");
+    }
+    if (points[0].second != 0 || points[N - 1].second != 0) throw std::invalid_argument("shapes must start and end at zero");
+    for (std::size_t i = 1; i < N; ++i) {
+        if (points[i].first <= points[i - 1].first) throw std::invalid_argument("breakpoints must be strictly increasing in x");
+    }
+}
+
+/**
+ * @brief Builds a table from breakpoint lists, one per shape, peaks being detected automatically.
+ *        Breakpoints must start at x = 0 and end at x = EnvSize - 1, both with value zero, and be
+ *        strictly increasing in x: invalid lists throw std::invalid_argument, a compile error
+ *        when the table is constexpr. Detected peaks are then always within the shape.
+ */
+template <int EnvSize, std::size_t... N>
+constexpr StaticEnvelopeTable<EnvSize, sizeof...(N)> makeStaticEnvelopeTable(const std::array<std::pair<int, float>, N>&... shapes)
+{
+    static_assert(EnvSize >= 2, "shapes need at least two points");
+    (checkStaticBreakpoints<EnvSize>(shapes), ...);
+
+    StaticEnvelopeTable<EnvSize, sizeof...(N)> table{};
+
+    int n = 0;
+    ((rasterizeLinearShape(shapes.data(), N, EnvSize, table.data.data() + n * EnvSize),
+      table.peaks[n] = findPeak(table.data.data() + n * EnvSize, EnvSize),
+      n++), ...);
+
+    return table;
+}
+
+template <int EnvSize, int NumberOfShapes>
+class StaticEnvelopesInterpolator
+{
+public:
+    constexpr StaticEnvelopesInterpolator(const StaticEnvelopeTable<EnvSize, NumberOfShapes>& table) : _table(table) {}
+
+    //the table is referenced, not copied: it must outlive the interpolator, which a temporary cannot
+    StaticEnvelopesInterpolator(const StaticEnvelopeTable<EnvSize, NumberOfShapes>&& table) = delete;
+
+    /**
+      * @brief Interpolates between two shapes based on a given factor.
+      *
+      * @param s Interpolation factor (0.0 ≤ s ≤ NumberOfShapes).
+      * @param targetbuffer Target buffer of EnvSize samples.
+      */
+    constexpr void interpolate(float s, float* targetbuffer) const
+    {
+        interpolateRange(s, 0, EnvSize, targetbuffer);
+    }
+
+    /**
+      * @brief Interpolates a portion of the shape only (start + count ≤ EnvSize).
+      */
+    constexpr void interpolateRange(float s, int start, int count, float* targetbuffer) const
+    {
+        if (targetbuffer == nullptr) return;
+        if (s < 0 || s >= NumberOfShapes) return;
+        if (start < 0 || count < 0 || start + count > EnvSize) return;
+
+        int i1 = static_cast<int>(s);
+        int i2 = (i1 + 1) % NumberOfShapes;
+        float s_dec = s - i1;
+
+        const float* shapeA = _table.data.data() + i1 * EnvSize;
+        const float* shapeB = _table.data.data() + i2 * EnvSize;
+
+        if (s_dec == 0) {
+            for (int i = 0; i < count; i++) targetbuffer[i] = shapeA[start + i];
+            return;
+        }
+
+        float ghost_peak_xpos = (_table.peaks[i2] - _table.peaks[i1]) * s_dec + _table.peaks[i1];
+        MorphGeometry g = makeMorphGeometry(ghost_peak_xpos, EnvSize);
+
+        morphShapesRange(shapeA, _table.peaks[i1], shapeB, _table.peaks[i2], s_dec, g, start, count, targetbuffer);
+    }
+
+    constexpr int getEnvSize() const { return EnvSize; }
+    constexpr int getNumberOfShapes() const { return NumberOfShapes; }
+
+private:
+    const StaticEnvelopeTable<EnvSize, NumberOfShapes>& _table;
+};
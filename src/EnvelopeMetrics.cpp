@@ -0,0 +1,202 @@
+#include "EnvelopeMetrics.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+//returns the shard to the registry when its thread exits
+struct ShardHandle {
+    MetricsRegistry::Shard* shard = nullptr;
+    ~ShardHandle()
+    {
+        if (shard != nullptr) shard->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local ShardHandle localShard;
+
+const char* const counterNames[] = {
+    "envelopes_calls_total",
+    "envelopes_rendered_samples_total",
+    "envelopes_rejected_inputs_total",
+    "envelopes_table_swaps_total",
+    "envelopes_cache_hits_total",
+    "envelopes_cache_misses_total",
+};
+
+const char* const counterHelp[] = {
+    "Render calls.",
+    "Samples rendered.",
+    "Calls rejected for invalid input.",
+    "Envelope tables replaced.",
+    "Render cache hits.",
+    "Render cache misses.",
+};
+
+}
+
+void MetricsRegistry::Shard::addLatency(std::uint64_t ns)
+{
+    int bucket = 0;
+    //upper bounds are inclusive, as Prometheus' le: a latency of exactly 2^b ns falls in bucket b
+    while (bucket < MetricsSnapshot::latencyBuckets - 1 && (std::uint64_t(1) << bucket) < ns) bucket++;
+    latency[bucket].store(latency[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    latencySumNs.store(latencySumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+MetricsRegistry& MetricsRegistry::global()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Shard& MetricsRegistry::local()
+{
+    if (localShard.shard != nullptr) return *localShard.shard;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& shard : _shards) {
+        bool free = false;
+        if (shard->inUse.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            localShard.shard = shard.get();
+            return *shard;
+        }
+    }
+    _shards.push_back(std::make_unique<Shard>());
+    _shards.back()->inUse.store(true, std::memory_order_relaxed);
+    localShard.shard = _shards.back().get();
+    return *localShard.shard;
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const
+{
+    MetricsSnapshot snapshot;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& shard : _shards) {
+        for (size_t m = 0; m < snapshot.counters.size(); m++) snapshot.counters[m] += shard->counters[m].load(std::memory_order_relaxed);
+        for (size_t b = 0; b < snapshot.latency.size(); b++) snapshot.latency[b] += shard->latency[b].load(std::memory_order_relaxed);
+        snapshot.latencySumNs += shard->latencySumNs.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void MetricsRegistry::writePrometheus(std::ostream& os) const
+{
+    MetricsSnapshot s = snapshot();
+
+    for (size_t m = 0; m < s.counters.size(); m++) {
+        os << "# HELP " << counterNames[m] << " " << counterHelp[m] << "\n";
+        os << "# TYPE " << counterNames[m] << " counter\n";
+        os << counterNames[m] << " " << s.counters[m] << "\n";
+    }
+
+    //buckets are cumulative in Prometheus, with upper bounds in seconds
+    os << "# HELP envelopes_render_latency_seconds Duration of render calls, when timing is enabled.\n";
+    os << "# TYPE envelopes_render_latency_seconds histogram\n";
+    std::uint64_t cumulative = 0;
+    for (int b = 0; b < MetricsSnapshot::latencyBuckets - 1; b++) {
+        cumulative += s.latency[b];
+        os << "envelopes_render_latency_seconds_bucket{le=\"" << static_cast<double>(std::uint64_t(1) << b) * 1e-9 << "\"} " << cumulative << "\n";
+    }
+    cumulative += s.latency[MetricsSnapshot::latencyBuckets - 1];
+    os << "envelopes_render_latency_seconds_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    os << "envelopes_render_latency_seconds_sum " << s.latencySumNs * 1e-9 << "\n";
+    os << "envelopes_render_latency_seconds_count " << cumulative << "\n";
+}
+
+bool MetricsExporter::startFile(const std::string& path, std::chrono::milliseconds interval)
+{
+    if (_running.exchange(true)) return false;
+
+    _thread = std::thread([this, path, interval] {
+        std::string temporary = path + ".tmp";
+        auto next = std::chrono::steady_clock::now();
+        while (_running.load()) {
+            {
+                std::ofstream file(temporary);
+                MetricsRegistry::global().writePrometheus(file);
+            }
+            std::rename(temporary.c_str(), path.c_str());
+
+            //sleep in short steps, so that stop() does not wait for a whole interval
+            next += interval;
+            while (_running.load() && std::chrono::steady_clock::now() < next) {
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(next - std::chrono::steady_clock::now(), std::chrono::milliseconds(50)));
+            }
+        }
+    });
+    return true;
+}
+
+bool MetricsExporter::startSocket(const std::string& path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    if (_running.exchange(true)) return false;
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        _running.store(false);
+        return false;
+    }
+    std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", path.c_str());
+
+    _socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (_socket < 0 || bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(_socket, 8) != 0) {
+        if (_socket >= 0) close(_socket);
+        _socket = -1;
+        _running.store(false);
+        return false;
+    }
+    _socketPath = path;
+
+    _thread = std::thread([this] {
+        while (_running.load()) {
+            //wake up regularly to notice stop()
+            pollfd pfd{ _socket, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) <= 0) continue;
+
+            int client = accept(_socket, nullptr, nullptr);
+            if (client < 0) continue;
+
+            std::ostringstream text;
+            MetricsRegistry::global().writePrometheus(text);
+            std::string response = text.str();
+            for (size_t sent = 0; sent < response.size();) {
+                ssize_t n = write(client, response.data() + sent, response.size() - sent);
+                if (n <= 0) break;
+                sent += static_cast<size_t>(n);
+            }
+            close(client);
+        }
+    });
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void MetricsExporter::stop()
+{
+    if (!_running.exchange(false)) return;
+    if (_thread.joinable()) _thread.join();
+
+#if defined(__unix__) || defined(__APPLE__)
+    if (_socket >= 0) {
+        close(_socket);
+        unlink(_socketPath.c_str());
+        _socket = -1;
+    }
+#endif
+}
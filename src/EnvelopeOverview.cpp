@@ -0,0 +1,144 @@
+#include "EnvelopeOverview.h"
+
+EnvelopeOverview::EnvelopeOverview(const EnvelopesInterpolator& et) : _et(et), _envsize(et.getEnvSize()), _levels(0), _pyramidSize(0)
+{
+    //level 0 is the shape itself, levels from 1 halve the number of blocks until one is left
+    _levelOffset.push_back(0);
+    for (int size = (_envsize + 1) / 2; _envsize > 1; size = (size + 1) / 2) {
+        _levelOffset.push_back(_pyramidSize);
+        _pyramidSize += size;
+        _levels++;
+        if (size == 1) break;
+    }
+
+    int numberOfShapes = et.getNumberOfShapes();
+    _mins.resize(static_cast<size_t>(numberOfShapes) * _pyramidSize);
+    _maxs.resize(static_cast<size_t>(numberOfShapes) * _pyramidSize);
+
+    for (int n = 0; n < numberOfShapes; n++) {
+        const float* shape = et.getShape(n);
+        float* mins = _mins.data() + static_cast<size_t>(n) * _pyramidSize;
+        float* maxs = _maxs.data() + static_cast<size_t>(n) * _pyramidSize;
+
+        int previousSize = _envsize;
+        for (int l = 1; l <= _levels; l++) {
+            int size = (previousSize + 1) / 2;
+            float* levelMins = mins + _levelOffset[l];
+            float* levelMaxs = maxs + _levelOffset[l];
+
+            for (int i = 0; i < size; i++) {
+                int a = 2 * i;
+                int b = std::min(a + 1, previousSize - 1);
+                if (l == 1) {
+                    levelMins[i] = std::min(shape[a], shape[b]);
+                    levelMaxs[i] = std::max(shape[a], shape[b]);
+                }
+                else {
+                    const float* previousMins = mins + _levelOffset[l - 1];
+                    const float* previousMaxs = maxs + _levelOffset[l - 1];
+                    levelMins[i] = std::min(previousMins[a], previousMins[b]);
+                    levelMaxs[i] = std::max(previousMaxs[a], previousMaxs[b]);
+                }
+            }
+            previousSize = size;
+        }
+    }
+    _trackedMemory.set(memoryBytes());
+}
+
+void EnvelopeOverview::rangeMinMax(int shape, int a, int b, float& min, float& max) const
+{
+    const float* points = _et.getShape(shape);
+    const float* mins = _mins.data() + static_cast<size_t>(shape) * _pyramidSize;
+    const float* maxs = _maxs.data() + static_cast<size_t>(shape) * _pyramidSize;
+
+    min = points[a];
+    max = points[a];
+
+    //take the largest aligned block starting at a that fits in the range, then move past it
+    while (a <= b) {
+        int l = 0;
+        while (l < _levels && (a & ((2 << l) - 1)) == 0 && a + (2 << l) - 1 <= b) l++;
+
+        if (l == 0) {
+            min = std::min(min, points[a]);
+            max = std::max(max, points[a]);
+        }
+        else {
+            int i = a >> l;
+            min = std::min(min, mins[_levelOffset[l] + i]);
+            max = std::max(max, maxs[_levelOffset[l] + i]);
+        }
+        a += 1 << l;
+    }
+}
+
+void EnvelopeOverview::warpedMinMax(int shape, float ghost_peak_xpos, float x0, float x1, float& min, float& max) const
+{
+    int peak = _et.getPeaks()[shape];
+    float last = static_cast<float>(_envsize - 1);
+
+    //inverse of the stretch: output position to source position, separately on each side of the peak
+    auto toSource = [&](float x) {
+        if (x <= ghost_peak_xpos) return (ghost_peak_xpos > 0) ? x * peak / ghost_peak_xpos : 0.0f;
+        return (last > ghost_peak_xpos) ? last - (last - x) * (last - peak) / (last - ghost_peak_xpos) : last;
+    };
+
+    float source0 = std::min(std::max(toSource(x0), 0.0f), last);
+    float source1 = std::min(std::max(toSource(x1), source0), last);
+
+    //shapes are linear between points: the extremes are at the range ends or at points inside it
+    const float* points = _et.getShape(shape);
+    auto pointAt = [&](float x) {
+        int i0 = static_cast<int>(x);
+        int i1 = std::min(i0 + 1, _envsize - 1);
+        return points[i0] + (x - i0) * (points[i1] - points[i0]);
+    };
+    float y0 = pointAt(source0);
+    float y1 = pointAt(source1);
+    min = std::min(y0, y1);
+    max = std::max(y0, y1);
+
+    int a = static_cast<int>(std::ceil(source0));
+    int b = static_cast<int>(std::floor(source1));
+    if (a <= b) {
+        float rangeMin, rangeMax;
+        rangeMinMax(shape, a, b, rangeMin, rangeMax);
+        min = std::min(min, rangeMin);
+        max = std::max(max, rangeMax);
+    }
+}
+
+void EnvelopeOverview::render(float s, int width, float* mins, float* maxs) const
+{
+    if (mins == nullptr || maxs == nullptr || width <= 0) return;
+
+    float coordinate = _et.getShapeCoordinate(s);
+    if (coordinate < 0) return;
+
+    int numberOfShapes = _et.getNumberOfShapes();
+    int i1 = static_cast<int>(coordinate);
+    int i2 = (i1 + 1) % numberOfShapes;
+    float s_dec = coordinate - i1;
+    float ghost_peak_xpos = _et.getGhostPeak(s);
+
+    float columnWidth = static_cast<float>(_envsize - 1) / width;
+
+    for (int c = 0; c < width; c++) {
+        float x0 = c * columnWidth;
+        float x1 = (c + 1) * columnWidth;
+
+        float minA, maxA;
+        warpedMinMax(i1, ghost_peak_xpos, x0, x1, minA, maxA);
+        if (s_dec == 0) {
+            mins[c] = minA;
+            maxs[c] = maxA;
+            continue;
+        }
+
+        float minB, maxB;
+        warpedMinMax(i2, ghost_peak_xpos, x0, x1, minB, maxB);
+        mins[c] = (1 - s_dec) * minA + s_dec * minB;
+        maxs[c] = (1 - s_dec) * maxA + s_dec * maxB;
+    }
+}
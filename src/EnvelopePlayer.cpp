@@ -0,0 +1,104 @@
+#include "EnvelopePlayer.h"
+
+EnvelopePlayer::EnvelopePlayer(const EnvelopesInterpolator& et, float increment)
+    : _et(et), _increment(increment), _loopStart(0), _loopEnd(0), _releasePoint(-1), _releaseFade(64),
+      _stage(Stage::Idle), _gate(false), _phase(0), _lastOutput(0), _offset(0), _offsetSamples(0)
+{
+}
+
+void EnvelopePlayer::setSustainLoop(float loopStart, float loopEnd)
+{
+    _loopStart = std::min(std::max(loopStart, 0.0f), 1.0f);
+    _loopEnd = std::min(std::max(loopEnd, 0.0f), 1.0f);
+}
+
+void EnvelopePlayer::setReleasePoint(float releasePoint)
+{
+    _releasePoint = std::min(releasePoint, 1.0f);
+}
+
+void EnvelopePlayer::noteOn()
+{
+    _stage = Stage::Attack;
+    _gate = true;
+    _phase = 0;
+
+    //retriggering a sounding note starts from zero: fade from where it was
+    _offset = _lastOutput;
+    _offsetSamples = _releaseFade;
+}
+
+void EnvelopePlayer::noteOff()
+{
+    if (!_gate) return;
+    _gate = false;
+
+    if (_releasePoint >= 0) {
+        _stage = Stage::Release;
+        _phase = _releasePoint;
+        _offsetSamples = -1;    // offset is computed on the next sample, once the new value is known
+    }
+    else if (_stage == Stage::Decay) {
+        //continue from the current position, just leaving the loop
+        _stage = Stage::Release;
+    }
+}
+
+float EnvelopePlayer::process(float s)
+{
+    if (_stage == Stage::Idle || _stage == Stage::Finished) {
+        _lastOutput = 0;
+        return 0;
+    }
+
+    float ghost = _et.getGhostPeak(s);
+    if (ghost < 0) return _lastOutput;
+
+    float attackLength = ghost;
+    float decayLength = _et.getEnvSize() - 1 - ghost;
+
+    float x = (_stage == Stage::Attack) ? _phase * attackLength : ghost + _phase * decayLength;
+    float y = _et.valueAt(s, x);
+
+    if (_offsetSamples < 0) {
+        _offset = _lastOutput - y;
+        _offsetSamples = _releaseFade;
+    }
+    if (_offsetSamples > 0) {
+        y += _offset * _offsetSamples / (_releaseFade + 1);
+        _offsetSamples--;
+    }
+
+    //advance
+    if (_stage == Stage::Attack) {
+        _phase = (attackLength > 0) ? _phase + _increment / attackLength : 1;
+        if (_phase >= 1) {
+            _phase = 0;
+            _stage = _gate ? Stage::Decay : Stage::Release;
+        }
+    }
+    else {
+        _phase = (decayLength > 0) ? _phase + _increment / decayLength : 1;
+
+        bool looping = (_stage == Stage::Decay && _loopEnd > _loopStart);
+        if (looping && _phase >= _loopEnd) {
+            _phase = _loopStart + std::fmod(_phase - _loopStart, _loopEnd - _loopStart);
+        }
+        else if (_phase >= 1) {
+            _stage = Stage::Finished;
+            _gate = false;
+        }
+    }
+
+    _lastOutput = y;
+    return y;
+}
+
+void EnvelopePlayer::process(float s, float* targetbuffer, int numSamples)
+{
+    if (targetbuffer == nullptr) return;
+
+    for (int n = 0; n < numSamples; n++) {
+        targetbuffer[n] = process(s);
+    }
+}
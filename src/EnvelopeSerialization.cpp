@@ -0,0 +1,328 @@
+#include "EnvelopeSerialization.h"
+
+#include <new>
+#include "EnvelopeTracing.h"
+
+static const std::uint32_t tableMagic = 0x54564E45;    // "ENVT"
+static const std::uint32_t patchMagic = 0x50564E45;    // "ENVP"
+static const std::uint16_t formatVersion = 2;    // 2 added the shape positions; 1 is still read
+static const std::uint8_t shapePositionsFlag = 1;  // table flags: axis length and positions follow the samples
+static const float quantizationRange = 32767.0f;
+
+//points a table message may hold (1 GiB as floats), checked before anything is allocated
+static const size_t maxTablePoints = size_t(1) << 28;
+
+template<typename T>
+static void writeValue(std::ostream& os, T value)
+{
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool readValue(std::istream& is, T& value)
+{
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T>
+static void writeArray(std::ostream& os, const T* values, size_t count)
+{
+    os.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+template<typename T>
+static bool readArray(std::istream& is, T* values, size_t count)
+{
+    return static_cast<bool>(is.read(reinterpret_cast<char*>(values), count * sizeof(T)));
+}
+
+//largest absolute value, the quantization step being scale / quantizationRange
+static float quantizationScale(const float* data, size_t count)
+{
+    float scale = 0;
+    for (size_t i = 0; i < count; i++) scale = std::max(scale, std::fabs(data[i]));
+    return (scale > 0) ? scale : 1.0f;
+}
+
+static void quantize(const float* data, size_t count, float scale, std::int16_t* quantized)
+{
+    float factor = quantizationRange / scale;
+    for (size_t i = 0; i < count; i++) {
+        quantized[i] = static_cast<std::int16_t>(std::lround(data[i] * factor));
+    }
+}
+
+static void dequantize(const std::int16_t* quantized, size_t count, float scale, float* data)
+{
+    float factor = scale / quantizationRange;
+    for (size_t i = 0; i < count; i++) data[i] = quantized[i] * factor;
+}
+
+//zigzag varints of the differences with the previous shape, the first shape being coded against zero
+static void encodeDeltas(const std::int16_t* quantized, int envsize, int numberOfShapes, std::vector<std::uint8_t>& bytes)
+{
+    bytes.clear();
+    bytes.reserve(static_cast<size_t>(envsize) * numberOfShapes);
+    for (int n = 0; n < numberOfShapes; n++) {
+        const std::int16_t* shape = quantized + static_cast<size_t>(n) * envsize;
+        for (int x = 0; x < envsize; x++) {
+            std::int32_t delta = shape[x] - ((n > 0) ? shape[x - envsize] : 0);
+            std::uint32_t zigzag = (static_cast<std::uint32_t>(delta) << 1) ^ static_cast<std::uint32_t>(delta >> 31);
+            while (zigzag >= 0x80) {
+                bytes.push_back(static_cast<std::uint8_t>(zigzag | 0x80));
+                zigzag >>= 7;
+            }
+            bytes.push_back(static_cast<std::uint8_t>(zigzag));
+        }
+    }
+}
+
+static bool decodeDeltas(const std::vector<std::uint8_t>& bytes, int envsize, int numberOfShapes, std::int16_t* quantized)
+{
+    size_t pos = 0;
+    size_t count = static_cast<size_t>(envsize) * numberOfShapes;
+    for (size_t i = 0; i < count; i++) {
+        std::uint32_t zigzag = 0;
+        for (int shift = 0; ; shift += 7) {
+            //differences of 16 bit values fit in three bytes
+            if (pos == bytes.size() || shift > 14) return false;
+            std::uint8_t byte = bytes[pos++];
+            zigzag |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) break;
+        }
+        std::int32_t delta = static_cast<std::int32_t>(zigzag >> 1) ^ -static_cast<std::int32_t>(zigzag & 1);
+        std::int32_t value = delta + ((i >= static_cast<size_t>(envsize)) ? quantized[i - envsize] : 0);
+        if (value < -32768 || value > 32767) return false;
+        quantized[i] = static_cast<std::int16_t>(value);
+    }
+    return pos == bytes.size();
+}
+
+//writes count points in the given encoding, Int16Delta excepted
+static void writeSamples(std::ostream& os, const float* data, size_t count, SampleEncoding encoding, float scale)
+{
+    if (encoding == SampleEncoding::Float32) {
+        writeArray(os, data, count);
+        return;
+    }
+
+    std::vector<std::int16_t> quantized(count);
+    quantize(data, count, scale, quantized.data());
+    writeArray(os, quantized.data(), count);
+}
+
+static bool readSamples(std::istream& is, float* data, size_t count, SampleEncoding encoding, float scale)
+{
+    if (encoding == SampleEncoding::Float32) return readArray(is, data, count);
+
+    std::vector<std::int16_t> quantized(count);
+    if (!readArray(is, quantized.data(), count)) return false;
+    dequantize(quantized.data(), count, scale, data);
+    return true;
+}
+
+//bytes left to read, or -1 when the stream cannot tell (pipes, sockets)
+static std::streamoff remainingBytes(std::istream& is)
+{
+    std::streampos pos = is.tellg();
+    if (pos == std::streampos(-1)) return -1;
+    is.seekg(0, std::ios::end);
+    std::streampos end = is.tellg();
+    is.seekg(pos);
+    if (!is || end == std::streampos(-1)) {
+        is.clear();
+        is.seekg(pos);
+        return -1;
+    }
+    return end - pos;
+}
+
+//smallest payload of a table message, the points of Int16Delta taking at least a byte each
+static size_t minimumPayload(size_t count, int numberOfShapes, SampleEncoding encoding)
+{
+    size_t peaks = static_cast<size_t>(numberOfShapes) * sizeof(std::int32_t);
+    switch (encoding) {
+    case SampleEncoding::Float32: return peaks + count * sizeof(float);
+    case SampleEncoding::Int16: return peaks + count * sizeof(std::int16_t);
+    default: return peaks + sizeof(std::uint64_t) + count;
+    }
+}
+
+//the conditions setShapePositions checks, so that a table is not half loaded when they fail
+static bool validPositions(const std::vector<float>& positions, float axisLength)
+{
+    if (positions.empty() || !(axisLength > 0) || !std::isfinite(axisLength)) return false;
+    if (!(positions[0] >= 0) || !(positions.back() < axisLength)) return false;
+    for (size_t i = 1; i < positions.size(); i++) {
+        if (!(positions[i] > positions[i - 1])) return false;
+    }
+    return true;
+}
+
+static bool validShapes(const float* data, const int* peaks, int envsize, int numberOfShapes)
+{
+    for (int n = 0; n < numberOfShapes; n++) {
+        const float* shape = data + static_cast<size_t>(n) * envsize;
+        if (shape[0] != 0 || shape[envsize - 1] != 0) return false;
+        if (peaks[n] < 0 || peaks[n] >= envsize) return false;
+    }
+    return true;
+}
+
+//peaks and points of a table message whose header has been read
+static bool readTablePayload(std::istream& is, SampleEncoding encoding, int envsize, int numberOfShapes, float scale, std::pmr::vector<int>& peaks, std::vector<float>& data)
+{
+    size_t count = static_cast<size_t>(envsize) * numberOfShapes;
+
+    peaks.resize(numberOfShapes);
+    if (!readArray(is, peaks.data(), peaks.size())) return false;
+
+    data.resize(count);
+    if (encoding == SampleEncoding::Int16Delta) {
+        std::uint64_t size;
+        if (!readValue(is, size) || size > 3 * count) return false;
+        std::vector<std::uint8_t> bytes(size);
+        if (!readArray(is, bytes.data(), bytes.size())) return false;
+        std::vector<std::int16_t> quantized(count);
+        if (!decodeDeltas(bytes, envsize, numberOfShapes, quantized.data())) return false;
+        dequantize(quantized.data(), count, scale, data.data());
+        return true;
+    }
+    return readSamples(is, data.data(), count, encoding, scale);
+}
+
+bool writeEnvelopeTable(std::ostream& os, const EnvelopesInterpolator& et, SampleEncoding encoding)
+{
+    ENVELOPES_TRACE_SCOPE("writeEnvelopeTable");
+    int envsize = et.getEnvSize();
+    int numberOfShapes = et.getNumberOfShapes();
+    size_t count = static_cast<size_t>(envsize) * numberOfShapes;
+    const float* data = (numberOfShapes > 0) ? et.getShape(0) : nullptr;
+    float scale = (encoding == SampleEncoding::Float32) ? 1.0f : quantizationScale(data, count);
+
+    const auto& positions = et.getShapePositions();
+
+    writeValue(os, tableMagic);
+    writeValue(os, formatVersion);
+    writeValue(os, static_cast<std::uint8_t>(encoding));
+    writeValue(os, positions.empty() ? std::uint8_t(0) : shapePositionsFlag);
+    writeValue(os, static_cast<std::int32_t>(envsize));
+    writeValue(os, static_cast<std::int32_t>(numberOfShapes));
+    writeValue(os, scale);
+    writeArray(os, et.getPeaks().data(), et.getPeaks().size());
+
+    if (encoding == SampleEncoding::Int16Delta) {
+        std::vector<std::int16_t> quantized(count);
+        quantize(data, count, scale, quantized.data());
+        std::vector<std::uint8_t> bytes;
+        encodeDeltas(quantized.data(), envsize, numberOfShapes, bytes);
+        writeValue(os, static_cast<std::uint64_t>(bytes.size()));
+        writeArray(os, bytes.data(), bytes.size());
+    }
+    else {
+        writeSamples(os, data, count, encoding, scale);
+    }
+
+    if (!positions.empty()) {
+        writeValue(os, et.getAxisLength());
+        writeArray(os, positions.data(), positions.size());
+    }
+
+    return static_cast<bool>(os);
+}
+
+bool readEnvelopeTable(std::istream& is, EnvelopesInterpolator& et)
+{
+    ENVELOPES_TRACE_SCOPE("readEnvelopeTable");
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint8_t encodingValue, flags;
+    std::int32_t envsize, numberOfShapes;
+    float scale;
+    if (!readValue(is, magic) || magic != tableMagic) return false;
+    if (!readValue(is, version) || version < 1 || version > formatVersion) return false;
+    if (!readValue(is, encodingValue) || encodingValue > static_cast<std::uint8_t>(SampleEncoding::Int16Delta)) return false;
+    if (!readValue(is, flags)) return false;
+    if ((version == 1 && flags != 0) || (flags & ~shapePositionsFlag) != 0) return false;
+    if (!readValue(is, envsize) || !readValue(is, numberOfShapes) || !readValue(is, scale)) return false;
+    if (envsize < 2 || numberOfShapes < 0 || !(scale > 0)) return false;
+
+    SampleEncoding encoding = static_cast<SampleEncoding>(encodingValue);
+    size_t count = static_cast<size_t>(envsize) * numberOfShapes;
+
+    //the header is untrusted: bound the table before sizing anything from it
+    if (count > maxTablePoints) return false;
+    std::streamoff remaining = remainingBytes(is);
+    if (remaining >= 0 && static_cast<size_t>(remaining) < minimumPayload(count, numberOfShapes, encoding)) return false;
+
+    EnvelopeTable table{ nullptr, envsize, numberOfShapes, {} };
+    std::vector<float> data;
+    try {
+        if (!readTablePayload(is, encoding, envsize, numberOfShapes, scale, table.peaks, data)) return false;
+    }
+    catch (const std::bad_alloc&) {
+        //a stream of unknown length can still announce more than can be allocated
+        return false;
+    }
+
+    if (!validShapes(data.data(), table.peaks.data(), envsize, numberOfShapes)) return false;
+
+    float axisLength = 0;
+    std::vector<float> positions;
+    if (flags & shapePositionsFlag) {
+        positions.resize(numberOfShapes);
+        if (!readValue(is, axisLength) || !readArray(is, positions.data(), positions.size())) return false;
+        if (!validPositions(positions, axisLength)) return false;
+    }
+
+    float none = 0;
+    table.data = (numberOfShapes > 0) ? data.data() : &none;
+    et.setEnvelopeTable(table);
+    if (!positions.empty()) et.setShapePositions(positions, axisLength);
+    return true;
+}
+
+bool writeShapePatch(std::ostream& os, const EnvelopesInterpolator& et, int shape, SampleEncoding encoding)
+{
+    if (shape < 0 || shape >= et.getNumberOfShapes()) return false;
+    if (encoding == SampleEncoding::Int16Delta) encoding = SampleEncoding::Int16;
+
+    int envsize = et.getEnvSize();
+    const float* data = et.getShape(shape);
+    float scale = (encoding == SampleEncoding::Float32) ? 1.0f : quantizationScale(data, envsize);
+
+    writeValue(os, patchMagic);
+    writeValue(os, formatVersion);
+    writeValue(os, static_cast<std::uint8_t>(encoding));
+    writeValue(os, std::uint8_t(0));
+    writeValue(os, static_cast<std::int32_t>(envsize));
+    writeValue(os, static_cast<std::int32_t>(shape));
+    writeValue(os, static_cast<std::int32_t>(et.getPeaks()[shape]));
+    writeValue(os, scale);
+    writeSamples(os, data, envsize, encoding, scale);
+
+    return static_cast<bool>(os);
+}
+
+bool applyShapePatch(std::istream& is, EnvelopesInterpolator& et)
+{
+    ENVELOPES_TRACE_SCOPE("applyShapePatch");
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint8_t encodingValue, reserved;
+    std::int32_t envsize, shape, peak;
+    float scale;
+    if (!readValue(is, magic) || magic != patchMagic) return false;
+    if (!readValue(is, version) || version < 1 || version > formatVersion) return false;
+    if (!readValue(is, encodingValue) || encodingValue > static_cast<std::uint8_t>(SampleEncoding::Int16)) return false;
+    if (!readValue(is, reserved)) return false;
+    if (!readValue(is, envsize) || !readValue(is, shape) || !readValue(is, peak) || !readValue(is, scale)) return false;
+    if (envsize != et.getEnvSize() || shape < 0 || shape >= et.getNumberOfShapes() || !(scale > 0)) return false;
+
+    std::vector<float> data(envsize);
+    if (!readSamples(is, data.data(), envsize, static_cast<SampleEncoding>(encodingValue), scale)) return false;
+    if (!validShapes(data.data(), &peak, envsize, 1)) return false;
+
+    et.replaceShape(shape, data.data(), peak);
+    return true;
+}
@@ -0,0 +1,138 @@
+#include "EnvelopeTracing.h"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> Tracer::_enabled{ false };
+
+namespace {
+
+const std::size_t eventsPerThread = 1 << 14;
+
+struct TraceEvent {
+    const char* name;
+    std::int64_t begin;
+    std::int64_t duration;
+    int tid;    // rings are reused by later threads, so each event keeps the id of its own
+};
+
+//written by its thread only; count is the number of events ever recorded
+struct alignas(64) TraceRing {
+    std::atomic<bool> inUse{ false };
+    std::atomic<std::uint64_t> count{ 0 };
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(eventsPerThread);
+};
+
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+TraceRegistry& registry()
+{
+    static TraceRegistry instance;
+    return instance;
+}
+
+int currentThreadId()
+{
+#if defined(__linux__)
+    return static_cast<int>(syscall(SYS_gettid));
+#else
+    return static_cast<int>(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0x7fffffff);
+#endif
+}
+
+//hands the ring back when its thread exits: its events stay available to dumps until overwritten
+struct RingHandle {
+    TraceRing* ring = nullptr;
+    int tid = 0;
+    ~RingHandle()
+    {
+        if (ring != nullptr) ring->inUse.store(false, std::memory_order_release);
+    }
+};
+
+thread_local RingHandle localHandle;
+
+RingHandle& localRing()
+{
+    if (localHandle.ring != nullptr) return localHandle;
+
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    localHandle.tid = currentThreadId();
+    for (auto& ring : r.rings) {
+        bool free = false;
+        if (ring->inUse.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            localHandle.ring = ring.get();
+            return localHandle;
+        }
+    }
+    r.rings.push_back(std::make_unique<TraceRing>());
+    r.rings.back()->inUse.store(true, std::memory_order_relaxed);
+    localHandle.ring = r.rings.back().get();
+    return localHandle;
+}
+
+}
+
+std::int64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry().epoch).count();
+}
+
+void Tracer::record(const char* name, std::int64_t begin, std::int64_t end)
+{
+    RingHandle& handle = localRing();
+    TraceRing& ring = *handle.ring;
+    std::uint64_t count = ring.count.load(std::memory_order_relaxed);
+    ring.events[count % eventsPerThread] = { name, begin, end - begin, handle.tid };
+    ring.count.store(count + 1, std::memory_order_release);
+}
+
+void Tracer::writeChromeTrace(std::ostream& os)
+{
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& ring : r.rings) {
+        std::uint64_t count = ring->count.load(std::memory_order_acquire);
+        std::uint64_t oldest = (count > eventsPerThread) ? count - eventsPerThread : 0;
+        for (std::uint64_t i = oldest; i < count; i++) {
+            const TraceEvent& event = ring->events[i % eventsPerThread];
+            //timestamps are in microseconds
+            os << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"envelopes\",\"ph\":\"X\",\"ts\":"
+               << event.begin / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << ",\"pid\":1,\"tid\":" << event.tid << "}";
+            first = false;
+        }
+    }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void Tracer::clear()
+{
+    TraceRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto& ring : r.rings) ring->count.store(0, std::memory_order_release);
+}
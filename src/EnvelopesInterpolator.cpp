@@ -1,25 +1,104 @@
 #include "EnvelopesInterpolator.h"
 
-EnvelopesInterpolator::EnvelopesInterpolator(int envsize) : _numberOfShapes(0), _envsize(envsize)
+#include <thread>
+#include "EnvelopeMetrics.h"
+#include "EnvelopeTracing.h"
+
+//samples rendered before gathering their statistics or changes, small enough to stay in L1
+static const int statsBlockSize = 256;
+
+static void rejectInput()
 {
+    MetricsRegistry::global().add(Metric::RejectedInputs);
 }
 
-EnvelopesInterpolator::EnvelopesInterpolator(EnvelopeTable e) : _numberOfShapes(e.numberOfShapes), _envsize(e.envsize)
+EnvelopesInterpolator::EnvelopesInterpolator(int envsize, std::pmr::memory_resource* resource)
+    : _shapes(resource), _numberOfShapes(0), _envsize(envsize), _peaks(resource), _positions(resource), _axisLength(0), _binScale(0), _positionIndex(resource)
 {
-    if (e.peaks.size() != _numberOfShapes) return;
+    updateMemoryAccounting();
+}
 
-    _peaks = std::vector<int>(e.peaks);
+EnvelopesInterpolator::EnvelopesInterpolator(const EnvelopeTable& e, std::pmr::memory_resource* resource)
+    : _shapes(resource), _numberOfShapes(e.numberOfShapes), _envsize(e.envsize), _peaks(resource), _positions(resource), _axisLength(static_cast<float>(e.numberOfShapes)), _binScale(0), _positionIndex(resource)
+{
+    if (e.peaks.size() == _numberOfShapes) {
+        _peaks.assign(e.peaks.begin(), e.peaks.end());
 
-    _shapes.resize(_numberOfShapes);
-    for (int i = 0; i < _numberOfShapes; i++) {
-        _shapes[i].resize(_envsize);
-        for (int j = 0; j < _envsize; j++) {
-            _shapes[i][j] = e.data[i * _envsize + j];
-        }
+        _shapes.assign(e.data, e.data + static_cast<size_t>(_numberOfShapes) * _envsize);
     }
+    updateMemoryAccounting();
+}
+
+//copies and moves are written out only to keep the memory tracker informed; the vectors move
+//without allocating and the tracker entry is embedded, so the move constructor never allocates
+EnvelopesInterpolator::EnvelopesInterpolator(const EnvelopesInterpolator& other)
+    : _shapes(other._shapes), _numberOfShapes(other._numberOfShapes), _envsize(other._envsize), _peaks(other._peaks), _positions(other._positions),
+      _axisLength(other._axisLength), _binScale(other._binScale), _positionIndex(other._positionIndex)
+{
+    updateMemoryAccounting();
+}
+
+EnvelopesInterpolator::EnvelopesInterpolator(EnvelopesInterpolator&& other) noexcept
+    : _shapes(std::move(other._shapes)), _numberOfShapes(other._numberOfShapes), _envsize(other._envsize), _peaks(std::move(other._peaks)), _positions(std::move(other._positions)),
+      _axisLength(other._axisLength), _binScale(other._binScale), _positionIndex(std::move(other._positionIndex))
+{
+    updateMemoryAccounting();
+    other.updateMemoryAccounting();
+}
+
+EnvelopesInterpolator& EnvelopesInterpolator::operator=(const EnvelopesInterpolator& other)
+{
+    if (this == &other) return *this;
+
+    _shapes = other._shapes;
+    _numberOfShapes = other._numberOfShapes;
+    _envsize = other._envsize;
+    _peaks = other._peaks;
+    _positions = other._positions;
+    _axisLength = other._axisLength;
+    _binScale = other._binScale;
+    _positionIndex = other._positionIndex;
+    updateMemoryAccounting();
+    return *this;
+}
+
+EnvelopesInterpolator& EnvelopesInterpolator::operator=(EnvelopesInterpolator&& other)
+{
+    if (this == &other) return *this;
+
+    _shapes = std::move(other._shapes);
+    _numberOfShapes = other._numberOfShapes;
+    _envsize = other._envsize;
+    _peaks = std::move(other._peaks);
+    _positions = std::move(other._positions);
+    _axisLength = other._axisLength;
+    _binScale = other._binScale;
+    _positionIndex = std::move(other._positionIndex);
+    updateMemoryAccounting();
+    other.updateMemoryAccounting();
+    return *this;
+}
+
+EnvelopesInterpolator::~EnvelopesInterpolator()
+{
+    MemoryTracker::global().remove(_trackerEntry);
+}
+
+MemoryUsage EnvelopesInterpolator::memoryUsage() const
+{
+    MemoryUsage usage;
+    usage.tableData = _shapes.capacity() * sizeof(float);
+    usage.perShape = _peaks.capacity() * sizeof(int) + _positions.capacity() * sizeof(float) + _positionIndex.capacity() * sizeof(int);
+    usage.object = sizeof(EnvelopesInterpolator);
+    return usage;
 }
 
-void EnvelopesInterpolator::interpolate(float s, float* targetbuffer)
+void EnvelopesInterpolator::updateMemoryAccounting()
+{
+    MemoryTracker::global().update(_trackerEntry, this, memoryUsage());
+}
+
+void EnvelopesInterpolator::interpolate(float s, float* targetbuffer) const
 {
     /*
         Interpolation Logic:
@@ -40,143 +119,445 @@ void EnvelopesInterpolator::interpolate(float s, float* targetbuffer)
         5. The adjusted sections from both shapes are recombined to form complete, intermediate curves.
 
         6. A linear interpolation is performed between the recombined curves to produce the final shape.
+
+        Steps 3 to 6 are fused: the stretched curves are never built, each output sample is computed
+        directly from the source points surrounding its stretched position (see MorphKernel.h).
     */
 
-    if (s < 0 || s >= _numberOfShapes) return;
-    
-    int s_int = (int)s;
-    float s_dec = s - s_int;
+    interpolateImpl(s, targetbuffer, nullptr);
+}
 
-    // If s is an integer, return the corresponding shape
-    if (s_dec == 0) {
-        for (int i = 0; i < _envsize; i++) {
-            targetbuffer[i] = _shapes[s_int][i];
-        }
+void EnvelopesInterpolator::interpolate(float s, std::vector<float>& targetbuffer) const
+{
+    if (targetbuffer.size() != _envsize) return rejectInput();
+    interpolate(s, targetbuffer.data());
+}
+
+void EnvelopesInterpolator::interpolate(float s, float* targetbuffer, RenderStats& stats) const
+{
+    interpolateImpl(s, targetbuffer, &stats);
+}
+
+void EnvelopesInterpolator::interpolateConstantTime(float s, float* targetbuffer) const
+{
+    if (targetbuffer == nullptr || _numberOfShapes == 0) return rejectInput();
+
+    ENVELOPES_TRACE_SCOPE("interpolateConstantTime");
+
+    RenderMetricsScope metrics(_envsize);
+
+    //an invalid s still goes through the kernel, with factor 0 and its output discarded
+    int i1, i2;
+    float s_dec;
+    bool valid = locateFixedCost(s, i1, i2, s_dec);
+    if (!valid) rejectInput();
+    float gain = valid ? 1.0f : 0.0f;
+
+    MorphGeometry g = makeMorphGeometry((_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1], _envsize);
+    constantTimeMorphRange(shapeData(i1), _peaks[i1], shapeData(i2), _peaks[i2], s_dec, g, 0, _envsize, targetbuffer);
+    for (int i = 0; i < _envsize; i++) targetbuffer[i] *= gain;
+}
+
+void EnvelopesInterpolator::interpolate(float s, float* targetbuffer, DeltaStream& delta) const
+{
+    ENVELOPES_TRACE_SCOPE("interpolate with delta");
+    delta.clear();
+
+    int i1, i2;
+    float s_dec;
+    if (targetbuffer == nullptr) return rejectInput();
+    if (!locate(s, i1, i2, s_dec)) return;
+
+    RenderMetricsScope metrics(_envsize);
+
+    //each block is rendered aside and compared with the previous render while still in L1
+    float block[statsBlockSize];
+    for (int start = 0; start < _envsize; start += statsBlockSize) {
+        int count = std::min(statsBlockSize, _envsize - start);
+        morphRange(i1, i2, s_dec, start, count, block);
+        delta.add(block, targetbuffer + start, start, count);
+    }
+    delta.finish();
+}
+
+void EnvelopesInterpolator::interpolateImpl(float s, float* targetbuffer, RenderStats* stats) const
+{
+    ENVELOPES_TRACE_SCOPE("interpolate");
+
+    //a rejected call must not leave the statistics of a previous render behind
+    if (stats) *stats = RenderStats();
+
+    int i1, i2;
+    float s_dec;
+    {
+        ENVELOPES_TRACE_SCOPE("locate");
+        if (!locate(s, i1, i2, s_dec)) return;
+    }
+
+    RenderMetricsScope metrics(_envsize);
+    ENVELOPES_TRACE_SCOPE(stats ? "morph and stats" : "morph");
+
+    if (stats == nullptr) {
+        morphRange(i1, i2, s_dec, 0, _envsize, targetbuffer);
         return;
     }
 
-    //ghost (float) peak position of new shape
-    float ghost_peak_xpos;
+    //render in blocks small enough to still be in cache when the statistics read them back
+    RenderStatsAccumulator accumulator;
+    for (int start = 0; start < _envsize; start += statsBlockSize) {
+        int count = std::min(statsBlockSize, _envsize - start);
+        morphRange(i1, i2, s_dec, start, count, targetbuffer + start);
+        accumulator.add(targetbuffer + start, start, count);
+    }
+    *stats = accumulator.result();
+}
+
+void EnvelopesInterpolator::interpolateRange(float s, int start, int count, float* targetbuffer) const
+{
+    if (targetbuffer == nullptr) return rejectInput();
+    if (start < 0 || count < 0 || start + count > _envsize) return rejectInput();
+
+    int i1, i2;
+    float s_dec;
+    if (!locate(s, i1, i2, s_dec)) return;
+
+    RenderMetricsScope metrics(count);
+    ENVELOPES_TRACE_SCOPE("interpolateRange");
+
+    morphRange(i1, i2, s_dec, start, count, targetbuffer);
+}
+
+void EnvelopesInterpolator::interpolateChunked(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback) const
+{
+    interpolateChunkedImpl(s, chunkSize, callback, nullptr);
+}
+
+void EnvelopesInterpolator::interpolateChunked(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback, RenderStats& stats) const
+{
+    interpolateChunkedImpl(s, chunkSize, callback, &stats);
+}
 
-    //left/right parts of shapes A and B (peak will be included in both)
-    std::vector<float> l_A;
-    std::vector<float> r_A;
-    std::vector<float> l_B;
-    std::vector<float> r_B;
+void EnvelopesInterpolator::interpolateChunkedImpl(float s, int chunkSize, const std::function<void(const float*, int, int)>& callback, RenderStats* stats) const
+{
+    if (stats) *stats = RenderStats();
+    if (chunkSize <= 0 || !callback) return rejectInput();
+
+    int i1, i2;
+    float s_dec;
+    if (!locate(s, i1, i2, s_dec)) return;
+
+    RenderMetricsScope metrics(_envsize);
+
+    ENVELOPES_TRACE_SCOPE("interpolateChunked");
+    std::pmr::vector<float> chunk(std::min(chunkSize, _envsize), getMemoryResource());
+    RenderStatsAccumulator accumulator;
+
+    for (int offset = 0; offset < _envsize; offset += chunkSize) {
+        int count = std::min(chunkSize, _envsize - offset);
+        {
+            ENVELOPES_TRACE_SCOPE("morph chunk");
+            morphRange(i1, i2, s_dec, offset, count, chunk.data());
+            if (stats) {
+                //the next chunk overwrites this one
+                accumulator.add(chunk.data(), offset, count);
+                accumulator.settle();
+            }
+        }
+        ENVELOPES_TRACE_SCOPE("chunk callback");
+        callback(chunk.data(), offset, count);
+    }
 
-    //new shapes A and B, stretched and shrunk to match the new peak position
-    std::vector<float> stretched_A;
-    std::vector<float> stretched_B;
+    if (stats) *stats = accumulator.result();
+}
 
-    int i1 = s_int;
-    int i2 = (s_int + 1) % _numberOfShapes;
+void EnvelopesInterpolator::interpolateBetween(int shape, float factor, float* targetbuffer) const
+{
+    if (targetbuffer == nullptr) return rejectInput();
+    if (shape < 0 || shape >= _numberOfShapes || factor < 0 || factor >= 1) return rejectInput();
 
-    ghost_peak_xpos = (_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1];
+    RenderMetricsScope metrics(_envsize);
+    ENVELOPES_TRACE_SCOPE("interpolateBetween");
 
-	float xspan_L = ghost_peak_xpos + 1;
-	float xspan_R = _envsize - ghost_peak_xpos;
+    morphRange(shape, (shape + 1) % _numberOfShapes, factor, 0, _envsize, targetbuffer);
+}
 
-	//if xspan_L is an integer, set excludePeak to true for the right parts to avoid including it twice
-	bool excludePeak = (xspan_L == static_cast<int>(xspan_L));
+void EnvelopesInterpolator::interpolateWeighted(const int* indices, const float* weights, int K, float* targetbuffer) const
+{
+    interpolateWeightedImpl(indices, weights, K, targetbuffer, nullptr);
+}
 
-    l_A = std::vector<float>(_shapes[i1].begin(), _shapes[i1].begin() + _peaks[i1] + 1);
-    r_A = std::vector<float>(_shapes[i1].begin() + _peaks[i1], _shapes[i1].end());
-    l_B = std::vector<float>(_shapes[i2].begin(), _shapes[i2].begin() + _peaks[i2] + 1);
-    r_B = std::vector<float>(_shapes[i2].begin() + _peaks[i2], _shapes[i2].end());
+void EnvelopesInterpolator::interpolateWeighted(const int* indices, const float* weights, int K, float* targetbuffer, RenderStats& stats) const
+{
+    interpolateWeightedImpl(indices, weights, K, targetbuffer, &stats);
+}
 
-    std::vector<float> stretched_A_L;
-    std::vector<float> stretched_B_L;
-    std::vector<float> stretched_A_R;
-    std::vector<float> stretched_B_R;
-    stretchCurve(l_A, stretched_A_L, xspan_L);
-    stretchCurve(l_B, stretched_B_L, xspan_L);
-	std::reverse(r_A.begin(), r_A.end());
-	std::reverse(r_B.begin(), r_B.end());
-	stretchCurve(r_A, stretched_A_R, xspan_R, excludePeak);
-	stretchCurve(r_B, stretched_B_R, xspan_R, excludePeak);
-	std::reverse(stretched_A_R.begin(), stretched_A_R.end());
-	std::reverse(stretched_B_R.begin(), stretched_B_R.end());
-        
-    stretched_A = std::vector<float>(stretched_A_L);
-    stretched_A.insert(stretched_A.end(), stretched_A_R.begin(), stretched_A_R.end());
-    stretched_B = std::vector<float>(stretched_B_L);
-    stretched_B.insert(stretched_B.end(), stretched_B_R.begin(), stretched_B_R.end());
+void EnvelopesInterpolator::interpolateWeightedImpl(const int* indices, const float* weights, int K, float* targetbuffer, RenderStats* stats) const
+{
+    /*
+        Generalization of the pairwise interpolation: the ghost peak is the weighted average of
+        the peaks, and every shape is stretched to it before being summed. Chaining pairwise
+        interpolations instead would stretch already stretched curves, and the resulting peak
+        would depend on the order of the chain.
+    */
+
+    if (stats) *stats = RenderStats();
+    if (indices == nullptr || weights == nullptr || targetbuffer == nullptr) return rejectInput();
+    if (K < 1 || K > maxBlendShapes) return rejectInput();
+
+    float totalWeight = 0;
+    for (int k = 0; k < K; k++) {
+        if (indices[k] < 0 || indices[k] >= _numberOfShapes || weights[k] < 0) return rejectInput();
+        totalWeight += weights[k];
+    }
+    if (totalWeight <= 0) return rejectInput();
+
+    RenderMetricsScope metrics(_envsize);
+    ENVELOPES_TRACE_SCOPE("interpolateWeighted");
 
-    // Interpolate between stretched_A and stretched_B
-    for (int i = 0; i < _envsize; i++) {
-        targetbuffer[i] = (1 - s_dec) * stretched_A[i] + s_dec * stretched_B[i];
+    const float* shapes[maxBlendShapes];
+    int peaks[maxBlendShapes];
+    float normalized[maxBlendShapes];
+    float ghost_peak_xpos = 0;
+
+    for (int k = 0; k < K; k++) {
+        shapes[k] = shapeData(indices[k]);
+        peaks[k] = _peaks[indices[k]];
+        normalized[k] = weights[k] / totalWeight;
+        ghost_peak_xpos += normalized[k] * peaks[k];
+    }
+
+    MorphGeometry g = makeMorphGeometry(ghost_peak_xpos, _envsize);
+
+    if (stats == nullptr) {
+        weightedMorphRange(shapes, peaks, normalized, K, g, 0, _envsize, targetbuffer);
+        return;
     }
+
+    RenderStatsAccumulator accumulator;
+    for (int start = 0; start < _envsize; start += statsBlockSize) {
+        int count = std::min(statsBlockSize, _envsize - start);
+        weightedMorphRange(shapes, peaks, normalized, K, g, start, count, targetbuffer + start);
+        accumulator.add(targetbuffer + start, start, count);
+    }
+    *stats = accumulator.result();
 }
 
-void EnvelopesInterpolator::interpolate(float s, std::vector<float>& targetbuffer)
+float EnvelopesInterpolator::renderAutomation(const std::vector<std::pair<int, float>>& keyframes, float phase, float increment, float* targetbuffer, int numSamples) const
 {
-    if (targetbuffer.size() != _envsize) return;
-    interpolate(s, targetbuffer.data());
+    /*
+        Every output sample is evaluated on its own: s is read from the automation lane, the
+        ghost peak is derived from it, and only the (at most four) source points surrounding the
+        read position are touched. The cost is O(numSamples), regardless of the number of
+        keyframes and of _envsize.
+    */
+
+    bool valid = targetbuffer != nullptr && numSamples > 0 && !keyframes.empty();
+    for (size_t k = 0; valid && k < keyframes.size(); k++) {
+        if (keyframes[k].second < 0 || keyframes[k].second >= getAxisLength()) valid = false;
+        if (k > 0 && keyframes[k].first < keyframes[k - 1].first) valid = false;
+    }
+    if (!valid) {
+        rejectInput();
+        return phase;
+    }
+
+    RenderMetricsScope metrics(numSamples);
+    ENVELOPES_TRACE_SCOPE("renderAutomation");
+
+    size_t k = 0;
+    for (int n = 0; n < numSamples; n++, phase += increment) {
+        //advance to the keyframe segment containing sample n
+        while (k + 1 < keyframes.size() && keyframes[k + 1].first <= n) k++;
+
+        float s;
+        if (n <= keyframes[k].first || k + 1 == keyframes.size()) {
+            s = keyframes[k].second;
+        }
+        else {
+            float t = static_cast<float>(n - keyframes[k].first) / (keyframes[k + 1].first - keyframes[k].first);
+            s = keyframes[k].second + t * (keyframes[k + 1].second - keyframes[k].second);
+        }
+
+        targetbuffer[n] = valueAt(s, phase);
+    }
+
+    return phase;
+}
+
+float EnvelopesInterpolator::valueAt(float s, float x) const
+{
+    int i1, i2;
+    float s_dec;
+    if (!locate(s, i1, i2, s_dec)) return 0;
+
+    //envelopes start and end at zero, so reading outside of them gives zero
+    if (x < 0 || x > _envsize - 1) return 0;
+
+    MorphGeometry g = makeMorphGeometry((_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1], _envsize);
+
+    int x0 = static_cast<int>(x);
+    int x1 = std::min(x0 + 1, _envsize - 1);
+    float t = x - x0;
+
+    float y0 = morphSample(i1, i2, s_dec, g, x0);
+    float y1 = morphSample(i1, i2, s_dec, g, x1);
+    return y0 + t * (y1 - y0);
 }
 
-void EnvelopesInterpolator::stretchCurve(const std::vector<float>& inputCurve, std::vector<float>& stretchedCurve, float v_len, bool excludePeak)
+float EnvelopesInterpolator::getGhostPeak(float s) const
 {
-	int originalSize = static_cast<int>(inputCurve.size());
-	int newSize = static_cast<int>(v_len) - static_cast<int>(excludePeak);
+    int i1, i2;
+    float s_dec;
+    if (!locate(s, i1, i2, s_dec)) return -1;
 
-	stretchedCurve.resize(newSize);
+    return (_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1];
+}
+
+bool EnvelopesInterpolator::locate(float s, int& i1, int& i2, float& s_dec) const
+{
+    if (_positions.empty()) {
+        if (s < 0 || s >= _numberOfShapes) {
+            rejectInput();
+            return false;
+        }
+
+        i1 = static_cast<int>(s);
+        i2 = (i1 + 1) % _numberOfShapes;
+        s_dec = s - i1;
+        return true;
+    }
 
-    for (int x = 0; x < newSize; ++x) {
-        float originalX = (x) * (originalSize - 1) / (v_len - 1);
+    if (s < 0 || s >= _axisLength) {
+        rejectInput();
+        return false;
+    }
 
-        int x0 = static_cast<int>(originalX);
-        int x1 = std::min(x0 + 1, originalSize - 1);
+    //the index table gives the last shape at or before the start of the bin; bins are narrower than
+    //the gap between shapes, so at most one more shape can start inside the bin
+    int bin = std::min(static_cast<int>(s * _binScale), static_cast<int>(_positionIndex.size()) - 1);
+    int i = _positionIndex[bin];
+    while (i + 1 < _numberOfShapes && _positions[i + 1] <= s) i++;
+
+    double factor;
+    if (i < 0) {
+        //before the first shape: between the last one and the first one, across the wraparound
+        i1 = _numberOfShapes - 1;
+        i2 = 0;
+        factor = (static_cast<double>(s) + _axisLength - _positions[i1]) / (static_cast<double>(_positions[0]) + _axisLength - _positions[i1]);
+    }
+    else {
+        double next = (i + 1 < _numberOfShapes) ? static_cast<double>(_positions[i + 1]) : static_cast<double>(_positions[0]) + _axisLength;
+        i1 = i;
+        i2 = (i + 1) % _numberOfShapes;
+        factor = (static_cast<double>(s) - _positions[i]) / (next - _positions[i]);
+    }
 
-        float y0 = inputCurve[x0];
-        float y1 = inputCurve[x1];
+    //a factor that rounds up to 1 is the next shape itself: s_dec must stay in [0, 1)
+    s_dec = static_cast<float>(factor);
+    if (s_dec >= 1) {
+        i1 = i2;
+        i2 = (i2 + 1) % _numberOfShapes;
+        s_dec = 0;
+    }
+    return true;
+}
 
-        float t = originalX - x0;
-        stretchedCurve[x] = y0 + t * (y1 - y0);
+bool EnvelopesInterpolator::locateFixedCost(float s, int& i1, int& i2, float& s_dec) const
+{
+    bool valid = s >= 0 && s < getAxisLength();
+    float t = valid ? s : 0.0f;
+
+    if (_positions.empty()) {
+        i1 = static_cast<int>(t);
+        i2 = (i1 + 1 == _numberOfShapes) ? 0 : i1 + 1;
+        s_dec = t - i1;
+        return valid;
+    }
+
+    //last shape at or before t, -1 if none: the number of steps depends on _numberOfShapes only
+    int base = 0;
+    for (int n = _numberOfShapes; n > 1; n -= n / 2) {
+        base = (_positions[base + n / 2] <= t) ? base + n / 2 : base;
+    }
+    int i = (_positions[base] <= t) ? base : -1;
+
+    //the two cases of locate, before the first shape or not, as one expression with the same rounding
+    bool wraps = i < 0;
+    i1 = wraps ? _numberOfShapes - 1 : i;
+    i2 = (i1 + 1 == _numberOfShapes) ? 0 : i1 + 1;
+    double before = wraps ? static_cast<double>(_axisLength) : 0.0;
+    double after = (i2 == 0) ? static_cast<double>(_axisLength) : 0.0;
+    double factor = (static_cast<double>(t) + before - _positions[i1]) / (static_cast<double>(_positions[i2]) + after - _positions[i1]);
+
+    s_dec = static_cast<float>(factor);
+    bool next = s_dec >= 1;
+    i1 = next ? i2 : i1;
+    i2 = next ? ((i2 + 1 == _numberOfShapes) ? 0 : i2 + 1) : i2;
+    s_dec = next ? 0.0f : s_dec;
+    return valid;
+}
+
+float EnvelopesInterpolator::morphSample(int i1, int i2, float s_dec, const MorphGeometry& g, int x) const
+{
+    if (s_dec == 0) return shapeData(i1)[x];
+
+    float a = stretchedSample(shapeData(i1), _peaks[i1], g, x);
+    float b = stretchedSample(shapeData(i2), _peaks[i2], g, x);
+    return (1 - s_dec) * a + s_dec * b;
+}
+
+void EnvelopesInterpolator::morphRange(int i1, int i2, float s_dec, int start, int count, float* targetbuffer) const
+{
+    // If s is an integer, return the corresponding shape
+    if (s_dec == 0) {
+        std::copy(shapeData(i1) + start, shapeData(i1) + start + count, targetbuffer);
+        return;
     }
+
+    //ghost (float) peak position of new shape
+    float ghost_peak_xpos = (_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1];
+    MorphGeometry g = makeMorphGeometry(ghost_peak_xpos, _envsize);
+
+    morphShapesRange(shapeData(i1), _peaks[i1], shapeData(i2), _peaks[i2], s_dec, g, start, count, targetbuffer);
 }
 
 //set new data and peaks, with data being a one dimensional array of size numberOfShapes*envsize
 void EnvelopesInterpolator::setDataAndPeaks(const float* data, const std::vector<int>& peaks)
 {
-    if (data == nullptr) return;
-	if (peaks.size() != _numberOfShapes) return;
+    ENVELOPES_TRACE_SCOPE("setDataAndPeaks");
+    if (data == nullptr) return rejectInput();
+	if (peaks.size() != _numberOfShapes) return rejectInput();
 	for (int i = 0; i < _numberOfShapes; i++) {
-		if (data[i * _envsize] != 0 || data[i * _envsize + _envsize - 1] != 0) return;
+		if (data[i * _envsize] != 0 || data[i * _envsize + _envsize - 1] != 0) return rejectInput();
 	}
     
     _numberOfShapes = peaks.size();
 
-    _shapes.resize(_numberOfShapes);
-    for (int n = 0; n < _numberOfShapes; n++) {
-        _shapes[n].resize(_envsize);
-        for (int i = 0; i < _envsize; i++) {
-            _shapes[n][i] = data[n * _envsize + i];
-        }
-    }
+    _shapes.assign(data, data + static_cast<size_t>(_numberOfShapes) * _envsize);
 
-    _peaks = std::vector<int>(peaks);
+    _peaks.assign(peaks.begin(), peaks.end());
+    MetricsRegistry::global().add(Metric::TableSwaps);
+    updateMemoryAccounting();
 }
 
 //set new data, peaks and envsize
-void EnvelopesInterpolator::setEnvelopeTable(EnvelopeTable e)
+void EnvelopesInterpolator::setEnvelopeTable(const EnvelopeTable& e)
 {
-    if (e.data == nullptr) return;
-    if (e.numberOfShapes != e.peaks.size()) return;
+    ENVELOPES_TRACE_SCOPE("setEnvelopeTable");
+    if (e.data == nullptr) return rejectInput();
+    if (e.numberOfShapes != e.peaks.size()) return rejectInput();
 	for (int i = 0; i < e.numberOfShapes; i++) {
-		if (e.data[i * e.envsize] != 0 || e.data[i * e.envsize + e.envsize - 1] != 0) return;
+		if (e.data[i * e.envsize] != 0 || e.data[i * e.envsize + e.envsize - 1] != 0) return rejectInput();
 	}
 
     _envsize = e.envsize;
     _numberOfShapes = e.numberOfShapes;
-    _peaks = std::vector<int>(e.peaks);
+    _peaks.assign(e.peaks.begin(), e.peaks.end());
+    resetShapePositions();
 
-    _shapes.resize(_numberOfShapes);
-    for (int n = 0; n < _numberOfShapes; n++) {
-        _shapes[n].resize(_envsize);
-        for (int i = 0; i < _envsize; i++) {
-            _shapes[n][i] = e.data[n * _envsize + i];
-        }
-    }
+    _shapes.assign(e.data, e.data + static_cast<size_t>(_numberOfShapes) * _envsize);
+    MetricsRegistry::global().add(Metric::TableSwaps);
+    updateMemoryAccounting();
 }
 
 //add a new shape at the end of the table
@@ -185,9 +566,22 @@ void EnvelopesInterpolator::addNewShape(const std::vector<float>& shape, int pea
 	if (shape.size() != _envsize) return;
 	if (shape[0] != 0 || shape[_envsize - 1] != 0) return;
 
-	_shapes.push_back(shape);
+	_shapes.insert(_shapes.end(), shape.begin(), shape.end());
 	_numberOfShapes++;
 	_peaks.push_back(peakPosition);
+	resetShapePositions();
+	updateMemoryAccounting();
+}
+
+//overwrite an existing shape, without reallocating the table
+void EnvelopesInterpolator::replaceShape(int n, const float* shape, int peakPosition)
+{
+    if (shape == nullptr || n < 0 || n >= _numberOfShapes) return;
+    if (shape[0] != 0 || shape[_envsize - 1] != 0) return;
+    if (peakPosition < 0 || peakPosition >= _envsize) return;
+
+    std::copy(shape, shape + _envsize, _shapes.begin() + static_cast<size_t>(n) * _envsize);
+    _peaks[n] = peakPosition;
 }
 
 //add a new shape, drawn via linear interpolation between given points, at the end of the table
@@ -196,21 +590,122 @@ void EnvelopesInterpolator::addLinearShape(const std::vector<std::pair<int, floa
     if (points[0].first != 0 || points[points.size()-1].first != _envsize - 1) return;
 	if (points[0].second != 0 || points[points.size() - 1].second != 0) return;
 
-    std::vector<float> newshape(_envsize);
+    _shapes.resize(_shapes.size() + _envsize);
+    rasterizeLinearShape(points.data(), points.size(), _envsize, _shapes.data() + _shapes.size() - _envsize);
+
+    _numberOfShapes++;
+    _peaks.push_back(peakPosition);
+    resetShapePositions();
+    updateMemoryAccounting();
+}
+
+//add new shapes, drawn via linear interpolation between given points, at the end of the table
+void EnvelopesInterpolator::addLinearShapes(const std::vector<std::vector<std::pair<int, float>>>& shapes, const std::vector<int>& peakPositions, int threads)
+{
+    if (shapes.size() != peakPositions.size()) return;
+    for (const auto& points : shapes) {
+        if (points.size() < 2) return;
+        if (points[0].first != 0 || points[points.size() - 1].first != _envsize - 1) return;
+        if (points[0].second != 0 || points[points.size() - 1].second != 0) return;
+    }
+
+    size_t first = _shapes.size();
+    _shapes.resize(first + shapes.size() * _envsize);
+    float* table = _shapes.data() + first;
+
+    //below a few thousand points per thread, starting threads costs more than it saves
+    size_t work = shapes.size() * _envsize;
+    if (threads <= 0) {
+        threads = static_cast<int>(std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), work / 65536 + 1));
+    }
+    threads = static_cast<int>(std::min<size_t>(threads, shapes.size()));
 
-    for (size_t i = 0; i < points.size() - 1; ++i) {
-        int x0 = points[i].first;
-        float y0 = points[i].second;
-        int x1 = points[i + 1].first;
-        float y1 = points[i + 1].second;
+    ENVELOPES_TRACE_SCOPE("addLinearShapes");
+    auto rasterize = [&](size_t begin, size_t end) {
+        ENVELOPES_TRACE_SCOPE("rasterize shapes");
+        for (size_t n = begin; n < end; n++) {
+            rasterizeLinearShape(shapes[n].data(), shapes[n].size(), _envsize, table + n * _envsize);
+        }
+    };
 
-        for (int x = x0; x <= x1; ++x) {
-            float t = static_cast<float>(x - x0) / (x1 - x0);
-            newshape[x] = y0 + t * (y1 - y0);
+    if (threads <= 1) {
+        rasterize(0, shapes.size());
+    }
+    else {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back(rasterize, shapes.size() * t / threads, shapes.size() * (t + 1) / threads);
         }
+        for (auto& worker : workers) worker.join();
+    }
+
+    _numberOfShapes += static_cast<int>(shapes.size());
+    _peaks.insert(_peaks.end(), peakPositions.begin(), peakPositions.end());
+    resetShapePositions();
+    updateMemoryAccounting();
+}
+
+//add a new shape, drawn with linear, Bezier and exponential segments, at the end of the table
+void EnvelopesInterpolator::addCurveShape(const std::vector<CurveSegment>& segments, int peakPosition)
+{
+    if (segments.empty()) return;
+    if (segments.back().x != _envsize - 1 || segments.back().y != 0) return;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (segments[i].x <= (i ? segments[i - 1].x : 0)) return;
     }
 
-    _shapes.push_back(newshape);
+    _shapes.resize(_shapes.size() + _envsize);
+    rasterizeCurveShape(segments.data(), segments.size(), _envsize, _shapes.data() + _shapes.size() - _envsize);
+
     _numberOfShapes++;
     _peaks.push_back(peakPosition);
+    resetShapePositions();
+    updateMemoryAccounting();
+}
+
+//place shapes at custom coordinates of the morph axis
+void EnvelopesInterpolator::setShapePositions(const std::vector<float>& positions, float axisLength)
+{
+    if (positions.size() != static_cast<size_t>(_numberOfShapes) || positions.empty()) return;
+    if (positions[0] < 0 || positions.back() >= axisLength) return;
+    float minimumGap = positions[0] + axisLength - positions.back();
+    for (size_t i = 1; i < positions.size(); i++) {
+        if (positions[i] <= positions[i - 1]) return;
+        minimumGap = std::min(minimumGap, positions[i] - positions[i - 1]);
+    }
+
+    _positions.assign(positions.begin(), positions.end());
+    _axisLength = axisLength;
+
+    //bins no wider than the smallest gap, within reason for very uneven spacings
+    int bins = static_cast<int>(std::min(std::ceil(axisLength / minimumGap), 65536.0f));
+    bins = std::max(bins, _numberOfShapes);
+    _binScale = bins / axisLength;
+
+    _positionIndex.resize(bins);
+    int i = -1;
+    for (int bin = 0; bin < bins; bin++) {
+        float binStart = bin / _binScale;
+        while (i + 1 < _numberOfShapes && _positions[i + 1] <= binStart) i++;
+        _positionIndex[bin] = i;
+    }
+    updateMemoryAccounting();
+}
+
+void EnvelopesInterpolator::resetShapePositions()
+{
+    _positions.clear();
+    _positionIndex.clear();
+    _axisLength = static_cast<float>(_numberOfShapes);
+}
+
+float EnvelopesInterpolator::getShapeCoordinate(float s) const
+{
+    int i1, i2;
+    float s_dec;
+    if (!locate(s, i1, i2, s_dec)) return -1;
+
+    //i1 + s_dec can round up to the next index, which for the last shape is out of range
+    float coordinate = i1 + s_dec;
+    return std::min(coordinate, std::nextafter(static_cast<float>(_numberOfShapes), 0.0f));
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "FixedEnvelopesInterpolator.h"
+
+#include <algorithm>
+#include <cstdint>
+
+//peaks are stored first, shapes follow at the next float-aligned address
+static std::size_t peaksBytes(int maxShapes)
+{
+    std::size_t bytes = static_cast<std::size_t>(maxShapes) * sizeof(int);
+    return (bytes + alignof(float) - 1) / alignof(float) * alignof(float);
+}
+
+FixedEnvelopesInterpolator::FixedEnvelopesInterpolator() : _data(nullptr), _peaks(nullptr), _maxShapes(0), _numberOfShapes(0), _envsize(0)
+{
+}
+
+std::size_t FixedEnvelopesInterpolator::requiredMemory(int envsize, int maxShapes)
+{
+    if (envsize <= 0 || maxShapes <= 0) return 0;
+    //extra room to align the start of the block
+    return alignof(int) - 1 + peaksBytes(maxShapes) + static_cast<std::size_t>(maxShapes) * envsize * sizeof(float);
+}
+
+InterpolatorStatus FixedEnvelopesInterpolator::init(void* memory, std::size_t bytes, int envsize, int maxShapes)
+{
+    if (memory == nullptr || envsize < 2 || maxShapes <= 0) return InterpolatorStatus::InvalidArgument;
+    if (bytes < requiredMemory(envsize, maxShapes)) return InterpolatorStatus::CapacityExceeded;
+
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(memory);
+    base = (base + alignof(int) - 1) / alignof(int) * alignof(int);
+
+    _peaks = reinterpret_cast<int*>(base);
+    _data = reinterpret_cast<float*>(base + peaksBytes(maxShapes));
+    _maxShapes = maxShapes;
+    _envsize = envsize;
+    _numberOfShapes = 0;
+
+    return InterpolatorStatus::Ok;
+}
+
+InterpolatorStatus FixedEnvelopesInterpolator::interpolate(float s, float* targetbuffer) const
+{
+    return interpolateRange(s, 0, _envsize, targetbuffer);
+}
+
+InterpolatorStatus FixedEnvelopesInterpolator::interpolateRange(float s, int start, int count, float* targetbuffer) const
+{
+    if (_data == nullptr) return InterpolatorStatus::NotInitialized;
+    if (targetbuffer == nullptr) return InterpolatorStatus::InvalidArgument;
+    if (start < 0 || count < 0 || start + count > _envsize) return InterpolatorStatus::InvalidArgument;
+    if (s < 0 || s >= _numberOfShapes) return InterpolatorStatus::OutOfRange;
+
+    int i1 = static_cast<int>(s);
+    int i2 = (i1 + 1) % _numberOfShapes;
+    float s_dec = s - i1;
+
+    const float* shapeA = _data + static_cast<std::size_t>(i1) * _envsize;
+    const float* shapeB = _data + static_cast<std::size_t>(i2) * _envsize;
+
+    if (s_dec == 0) {
+        std::copy(shapeA + start, shapeA + start + count, targetbuffer);
+        return InterpolatorStatus::Ok;
+    }
+
+    float ghost_peak_xpos = (_peaks[i2] - _peaks[i1]) * s_dec + _peaks[i1];
+    MorphGeometry g = makeMorphGeometry(ghost_peak_xpos, _envsize);
+
+    morphShapesRange(shapeA, _peaks[i1], shapeB, _peaks[i2], s_dec, g, start, count, targetbuffer);
+    return InterpolatorStatus::Ok;
+}
+
+InterpolatorStatus FixedEnvelopesInterpolator::setDataAndPeaks(const float* data, const int* peaks, int numberOfShapes)
+{
+    if (_data == nullptr) return InterpolatorStatus::NotInitialized;
+    if (data == nullptr || peaks == nullptr || numberOfShapes < 0) return InterpolatorStatus::InvalidArgument;
+    if (numberOfShapes > _maxShapes) return InterpolatorStatus::CapacityExceeded;
+    for (int n = 0; n < numberOfShapes; n++) {
+        if (!isValidShape(data + static_cast<std::size_t>(n) * _envsize, peaks[n])) return InterpolatorStatus::InvalidShape;
+    }
+
+    std::copy(data, data + static_cast<std::size_t>(numberOfShapes) * _envsize, _data);
+    std::copy(peaks, peaks + numberOfShapes, _peaks);
+    _numberOfShapes = numberOfShapes;
+
+    return InterpolatorStatus::Ok;
+}
+
+//add a new shape at the end of the table
+InterpolatorStatus FixedEnvelopesInterpolator::addNewShape(const float* shape, int peakPosition)
+{
+    if (_data == nullptr) return InterpolatorStatus::NotInitialized;
+    if (shape == nullptr) return InterpolatorStatus::InvalidArgument;
+    if (_numberOfShapes == _maxShapes) return InterpolatorStatus::CapacityExceeded;
+    if (!isValidShape(shape, peakPosition)) return InterpolatorStatus::InvalidShape;
+
+    std::copy(shape, shape + _envsize, _data + static_cast<std::size_t>(_numberOfShapes) * _envsize);
+    _peaks[_numberOfShapes] = peakPosition;
+    _numberOfShapes++;
+
+    return InterpolatorStatus::Ok;
+}
+
+//add a new shape, drawn via linear interpolation between given points, at the end of the table
+InterpolatorStatus FixedEnvelopesInterpolator::addLinearShape(const std::pair<int, float>* points, std::size_t numberOfPoints, int peakPosition)
+{
+    if (_data == nullptr) return InterpolatorStatus::NotInitialized;
+    if (points == nullptr || numberOfPoints < 2) return InterpolatorStatus::InvalidArgument;
+    if (_numberOfShapes == _maxShapes) return InterpolatorStatus::CapacityExceeded;
+    if (points[0].first != 0 || points[numberOfPoints - 1].first != _envsize - 1) return InterpolatorStatus::InvalidShape;
+    if (points[0].second != 0 || points[numberOfPoints - 1].second != 0) return InterpolatorStatus::InvalidShape;
+    if (peakPosition < 0 || peakPosition >= _envsize) return InterpolatorStatus::InvalidShape;
+
+    //the slot past the last shape is used directly, it only becomes part of the table once complete
+    rasterizeLinearShape(points, numberOfPoints, _envsize, _data + static_cast<std::size_t>(_numberOfShapes) * _envsize);
+    _peaks[_numberOfShapes] = peakPosition;
+    _numberOfShapes++;
+
+    return InterpolatorStatus::Ok;
+}
+
+void FixedEnvelopesInterpolator::clear()
+{
+    _numberOfShapes = 0;
+}
+
+bool FixedEnvelopesInterpolator::isValidShape(const float* shape, int peakPosition) const
+{
+    if (peakPosition < 0 || peakPosition >= _envsize) return false;
+    return shape[0] == 0 && shape[_envsize - 1] == 0;
+}
@@ -0,0 +1,112 @@
+#include "HugePageResource.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+static std::size_t roundToHugePages(std::size_t bytes)
+{
+    return (bytes + HugePageResource::hugePageSize - 1) / HugePageResource::hugePageSize * HugePageResource::hugePageSize;
+}
+
+HugePageResource::HugePageResource(std::size_t minimumSize, bool tryHugeTLB, std::pmr::memory_resource* upstream)
+    : _minimumSize(minimumSize), _tryHugeTLB(tryHugeTLB), _upstream(upstream), _requestedBacking(PageBacking::Regular)
+{
+}
+
+void* HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+#if defined(__linux__)
+    if (bytes >= _minimumSize && alignment <= hugePageSize) {
+        std::size_t length = roundToHugePages(bytes);
+
+        if (_tryHugeTLB) {
+            void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                _requestedBacking = PageBacking::HugeTLB;
+                return p;
+            }
+        }
+
+        //over-allocate so that the mapping can be trimmed to a 2 MB boundary, as THP requires
+        void* raw = mmap(nullptr, length + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+
+        std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(raw);
+        std::uintptr_t aligned = (begin + hugePageSize - 1) / hugePageSize * hugePageSize;
+        if (aligned > begin) munmap(raw, aligned - begin);
+        std::uintptr_t end = begin + length + hugePageSize;
+        if (end > aligned + length) munmap(reinterpret_cast<void*>(aligned + length), end - aligned - length);
+
+        void* p = reinterpret_cast<void*>(aligned);
+        _requestedBacking = (madvise(p, length, MADV_HUGEPAGE) == 0) ? PageBacking::TransparentHugePages : PageBacking::Regular;
+        return p;
+    }
+#endif
+    return _upstream->allocate(bytes, alignment);
+}
+
+void HugePageResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+{
+#if defined(__linux__)
+    if (bytes >= _minimumSize && alignment <= hugePageSize) {
+        munmap(p, roundToHugePages(bytes));
+        return;
+    }
+#endif
+    _upstream->deallocate(p, bytes, alignment);
+}
+
+bool HugePageResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+PageBacking HugePageResource::queryBacking(const void* p)
+{
+#if defined(__linux__)
+    //find the mapping containing p in smaps and look at its page size and huge page usage
+    FILE* smaps = std::fopen("/proc/self/smaps", "r");
+    if (smaps == nullptr) return PageBacking::Regular;
+
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(p);
+    bool inMapping = false;
+    PageBacking backing = PageBacking::Regular;
+    char line[512];
+
+    while (std::fgets(line, sizeof(line), smaps)) {
+        unsigned long begin, end;
+        //mapping headers start with "begin-end", attribute lines with a name
+        if (std::sscanf(line, "%lx-%lx", &begin, &end) == 2) {
+            if (inMapping) break;
+            inMapping = (address >= begin && address < end);
+            continue;
+        }
+        if (!inMapping) continue;
+
+        unsigned long kb;
+        if (std::sscanf(line, "KernelPageSize: %lu kB", &kb) == 1 && kb >= 2048) backing = PageBacking::HugeTLB;
+        if (std::sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 && kb > 0 && backing == PageBacking::Regular) backing = PageBacking::TransparentHugePages;
+    }
+
+    std::fclose(smaps);
+    return backing;
+#else
+    (void)p;
+    return PageBacking::Regular;
+#endif
+}
+
+const char* HugePageResource::backingName(PageBacking backing)
+{
+    switch (backing) {
+    case PageBacking::HugeTLB: return "hugetlbfs";
+    case PageBacking::TransparentHugePages: return "transparent huge pages";
+    default: return "regular pages";
+    }
+}
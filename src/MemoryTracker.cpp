@@ -0,0 +1,122 @@
+#include "MemoryTracker.h"
+
+MemoryTracker& MemoryTracker::global()
+{
+    static MemoryTracker tracker;
+    return tracker;
+}
+
+MemoryUsage MemoryTracker::total() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _total;
+}
+
+std::size_t MemoryTracker::liveInstances() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _liveInstances;
+}
+
+void MemoryTracker::forEachInstance(const std::function<void(const EnvelopesInterpolator&, const MemoryUsage&)>& f) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const Entry* entry = _first; entry != nullptr; entry = entry->_next) {
+        if (entry->_instance != nullptr) f(*entry->_instance, entry->_usage);
+    }
+}
+
+void MemoryTracker::setBudget(std::size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = bytes;
+}
+
+std::size_t MemoryTracker::getBudget() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budget;
+}
+
+bool MemoryTracker::overBudget() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budget > 0 && _total.total() > _budget;
+}
+
+static void subtract(MemoryUsage& total, const MemoryUsage& usage)
+{
+    total.tableData -= usage.tableData;
+    total.perShape -= usage.perShape;
+    total.caches -= usage.caches;
+    total.scratch -= usage.scratch;
+    total.object -= usage.object;
+}
+
+void MemoryTracker::update(Entry& entry, const EnvelopesInterpolator* instance, const MemoryUsage& usage)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!entry._registered) {
+        entry._instance = instance;
+        entry._usage = MemoryUsage();
+        entry._previous = nullptr;
+        entry._next = _first;
+        if (_first != nullptr) _first->_previous = &entry;
+        _first = &entry;
+        entry._registered = true;
+        if (instance != nullptr) _liveInstances++;
+    }
+    subtract(_total, entry._usage);
+    _total += usage;
+    entry._usage = usage;
+}
+
+void MemoryTracker::remove(Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!entry._registered) return;
+    subtract(_total, entry._usage);
+    if (entry._previous != nullptr) entry._previous->_next = entry._next;
+    else _first = entry._next;
+    if (entry._next != nullptr) entry._next->_previous = entry._previous;
+    if (entry._instance != nullptr) _liveInstances--;
+    entry._registered = false;
+}
+
+TrackedCacheMemory::TrackedCacheMemory(const TrackedCacheMemory& other)
+{
+    set(other._bytes);
+}
+
+TrackedCacheMemory::TrackedCacheMemory(TrackedCacheMemory&& other) noexcept
+{
+    set(other._bytes);
+    other.set(0);
+}
+
+TrackedCacheMemory& TrackedCacheMemory::operator=(const TrackedCacheMemory& other)
+{
+    if (this != &other) set(other._bytes);
+    return *this;
+}
+
+TrackedCacheMemory& TrackedCacheMemory::operator=(TrackedCacheMemory&& other)
+{
+    if (this == &other) return *this;
+    set(other._bytes);
+    other.set(0);
+    return *this;
+}
+
+TrackedCacheMemory::~TrackedCacheMemory()
+{
+    MemoryTracker::global().remove(_entry);
+}
+
+void TrackedCacheMemory::set(std::size_t bytes)
+{
+    _bytes = bytes;
+    MemoryUsage usage;
+    usage.caches = bytes;
+    MemoryTracker::global().update(_entry, nullptr, usage);
+}
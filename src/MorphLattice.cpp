@@ -0,0 +1,183 @@
+#include "MorphLattice.h"
+#include "EnvelopeTracing.h"
+
+MorphLattice::MorphLattice(const EnvelopesInterpolator& et, int framesPerPair, bool measureError)
+    : _envsize(et.getEnvSize()), _numberOfShapes(et.getNumberOfShapes()), _framesPerPair(std::max(framesPerPair, 1)), _maxError(0)
+{
+    ENVELOPES_TRACE_SCOPE("build MorphLattice");
+
+    int numberOfFrames = _numberOfShapes * _framesPerPair;
+    _frames.resize(static_cast<size_t>(numberOfFrames) * _envsize);
+
+    for (int f = 0; f < numberOfFrames; f++) {
+        float factor = static_cast<float>(f % _framesPerPair) / _framesPerPair;
+        et.interpolateBetween(f / _framesPerPair, factor, _frames.data() + static_cast<size_t>(f) * _envsize);
+    }
+    _trackedMemory.set(memoryBytes());
+
+    if (!measureError) return;
+
+    ENVELOPES_TRACE_SCOPE("measure MorphLattice error");
+
+    //the error is largest where the lattice is furthest from its samples: halfway between frames
+    std::vector<float> exact(_envsize);
+    std::vector<float> approximated(_envsize);
+    for (int f = 0; f < numberOfFrames; f++) {
+        float factor = (f % _framesPerPair + 0.5f) / _framesPerPair;
+        et.interpolateBetween(f / _framesPerPair, factor, exact.data());
+        interpolate(f / _framesPerPair + factor, approximated.data());
+        for (int i = 0; i < _envsize; i++) {
+            _maxError = std::max(_maxError, std::fabs(exact[i] - approximated[i]));
+        }
+    }
+}
+
+std::size_t MorphLattice::estimateMemory(int envsize, int numberOfShapes, int framesPerPair)
+{
+    return static_cast<std::size_t>(numberOfShapes) * std::max(framesPerPair, 1) * envsize * sizeof(float);
+}
+
+bool MorphLattice::locate(float s, const float*& frameA, const float*& frameB, float& t) const
+{
+    if (s < 0 || s >= _numberOfShapes) return false;
+
+    int numberOfFrames = _numberOfShapes * _framesPerPair;
+    float u = s * _framesPerPair;
+    int f0 = std::min(static_cast<int>(u), numberOfFrames - 1);
+    int f1 = (f0 + 1) % numberOfFrames;    // the last frames fade back into the first shape
+
+    frameA = _frames.data() + static_cast<size_t>(f0) * _envsize;
+    frameB = _frames.data() + static_cast<size_t>(f1) * _envsize;
+    t = u - f0;
+    return true;
+}
+
+float MorphLattice::valueAt(float s, float x) const
+{
+    const float* frameA;
+    const float* frameB;
+    float t;
+    if (!locate(s, frameA, frameB, t)) return 0;
+    if (x < 0 || x > _envsize - 1) return 0;
+
+    int x0 = static_cast<int>(x);
+    int x1 = std::min(x0 + 1, _envsize - 1);
+    float tx = x - x0;
+
+    float a = frameA[x0] + tx * (frameA[x1] - frameA[x0]);
+    float b = frameB[x0] + tx * (frameB[x1] - frameB[x0]);
+    return a + t * (b - a);
+}
+
+void MorphLattice::interpolate(float s, float* targetbuffer) const
+{
+    const float* frameA;
+    const float* frameB;
+    float t;
+    if (targetbuffer == nullptr || !locate(s, frameA, frameB, t)) return;
+
+    for (int i = 0; i < _envsize; i++) {
+        targetbuffer[i] = frameA[i] + t * (frameB[i] - frameA[i]);
+    }
+}
+
+AdaptiveMorphLattice::AdaptiveMorphLattice(const EnvelopesInterpolator& et, float tolerance, int maxDepth)
+    : _envsize(et.getEnvSize()), _numberOfShapes(et.getNumberOfShapes()), _tolerance(tolerance), _maxDepth(maxDepth), _maxError(0)
+{
+    ENVELOPES_TRACE_SCOPE("build AdaptiveMorphLattice");
+
+    std::vector<float> first(_envsize);
+    std::vector<float> last(_envsize);
+
+    _pairOffset.push_back(0);
+    for (int pair = 0; pair < _numberOfShapes; pair++) {
+        //a pair spans from its shape to the next one, whose frame belongs to the next pair
+        et.interpolateBetween(pair, 0, first.data());
+        et.interpolateBetween((pair + 1) % _numberOfShapes, 0, last.data());
+
+        _frames.insert(_frames.end(), first.begin(), first.end());
+        _breakpoints.push_back(0);
+        subdivide(et, pair, 0, first, 1, last, 0);
+
+        _pairOffset.push_back(static_cast<int>(_breakpoints.size()));
+    }
+    _trackedMemory.set(memoryBytes());
+}
+
+void AdaptiveMorphLattice::subdivide(const EnvelopesInterpolator& et, int pair, float a, const std::vector<float>& frameA, float b, const std::vector<float>& frameB, int depth)
+{
+    float mid = 0.5f * (a + b);
+    std::vector<float> frameMid(_envsize);
+    et.interpolateBetween(pair, mid, frameMid.data());
+
+    float error = 0;
+    for (int i = 0; i < _envsize; i++) {
+        error = std::max(error, std::fabs(frameMid[i] - 0.5f * (frameA[i] + frameB[i])));
+    }
+
+    if (error <= _tolerance || depth >= _maxDepth) {
+        _maxError = std::max(_maxError, error);
+        return;
+    }
+
+    subdivide(et, pair, a, frameA, mid, frameMid, depth + 1);
+    _frames.insert(_frames.end(), frameMid.begin(), frameMid.end());
+    _breakpoints.push_back(mid);
+    subdivide(et, pair, mid, frameMid, b, frameB, depth + 1);
+}
+
+std::size_t AdaptiveMorphLattice::memoryBytes() const
+{
+    return _frames.size() * sizeof(float) + _breakpoints.size() * sizeof(float) + _pairOffset.size() * sizeof(int);
+}
+
+bool AdaptiveMorphLattice::locate(float s, const float*& frameA, const float*& frameB, float& t) const
+{
+    if (s < 0 || s >= _numberOfShapes) return false;
+
+    int pair = static_cast<int>(s);
+    float u = s - pair;
+
+    const float* begin = _breakpoints.data() + _pairOffset[pair];
+    const float* end = _breakpoints.data() + _pairOffset[pair + 1];
+    int j = static_cast<int>(std::upper_bound(begin, end, u) - begin) - 1;
+
+    int fA = _pairOffset[pair] + j;
+    //the frame after the last one of a pair is the first one of the next pair
+    int fB = (fA + 1 < _pairOffset[pair + 1]) ? fA + 1 : _pairOffset[(pair + 1) % _numberOfShapes];
+    float b = (fA + 1 < _pairOffset[pair + 1]) ? begin[j + 1] : 1.0f;
+
+    frameA = _frames.data() + static_cast<size_t>(fA) * _envsize;
+    frameB = _frames.data() + static_cast<size_t>(fB) * _envsize;
+    t = (u - begin[j]) / (b - begin[j]);
+    return true;
+}
+
+float AdaptiveMorphLattice::valueAt(float s, float x) const
+{
+    const float* frameA;
+    const float* frameB;
+    float t;
+    if (!locate(s, frameA, frameB, t)) return 0;
+    if (x < 0 || x > _envsize - 1) return 0;
+
+    int x0 = static_cast<int>(x);
+    int x1 = std::min(x0 + 1, _envsize - 1);
+    float tx = x - x0;
+
+    float a = frameA[x0] + tx * (frameA[x1] - frameA[x0]);
+    float b = frameB[x0] + tx * (frameB[x1] - frameB[x0]);
+    return a + t * (b - a);
+}
+
+void AdaptiveMorphLattice::interpolate(float s, float* targetbuffer) const
+{
+    const float* frameA;
+    const float* frameB;
+    float t;
+    if (targetbuffer == nullptr || !locate(s, frameA, frameB, t)) return;
+
+    for (int i = 0; i < _envsize; i++) {
+        targetbuffer[i] = frameA[i] + t * (frameB[i] - frameA[i]);
+    }
+}
@@ -0,0 +1,133 @@
+#include "NumaReplicatedInterpolator.h"
+#include "EnvelopeTracing.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//parses a sysfs cpu list such as "0-3,8-11"
+static std::vector<int> parseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::detect()
+{
+    NumaTopology topology;
+    topology.numberOfNodes = 0;
+
+    for (int node = 0; ; node++) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!file) break;
+
+        std::string list;
+        std::getline(file, list);
+        topology.cpusOfNode.push_back(parseCpuList(list));
+        topology.numberOfNodes++;
+    }
+
+    if (topology.numberOfNodes <= 1) {
+        topology.numberOfNodes = 1;
+        topology.cpusOfNode.clear();
+        topology.currentNode = [] { return 0; };
+        return topology;
+    }
+
+#if defined(__linux__)
+    std::vector<int> nodeOfCpu;
+    for (int node = 0; node < topology.numberOfNodes; node++) {
+        for (int cpu : topology.cpusOfNode[node]) {
+            if (cpu >= static_cast<int>(nodeOfCpu.size())) nodeOfCpu.resize(cpu + 1, 0);
+            nodeOfCpu[cpu] = node;
+        }
+    }
+    topology.currentNode = [nodeOfCpu] {
+        int cpu = sched_getcpu();
+        return (cpu >= 0 && cpu < static_cast<int>(nodeOfCpu.size())) ? nodeOfCpu[cpu] : 0;
+    };
+#else
+    topology.currentNode = [] { return 0; };
+#endif
+
+    return topology;
+}
+
+NumaTopology NumaTopology::simulated(int numberOfNodes, std::function<int()> currentNode)
+{
+    NumaTopology topology;
+    topology.numberOfNodes = std::max(numberOfNodes, 1);
+    topology.currentNode = currentNode;
+    return topology;
+}
+
+NumaReplicatedInterpolator::NumaReplicatedInterpolator(const EnvelopeTable& e, NumaTopology topology) : _topology(topology)
+{
+    if (!_topology.currentNode) _topology.currentNode = [] { return 0; };
+
+    _replicas.resize(_topology.numberOfNodes);
+    for (int node = 0; node < _topology.numberOfNodes; node++) {
+        runOnNode(node, [&] {
+            ENVELOPES_TRACE_SCOPE("build replica");
+            _replicas[node] = std::make_unique<EnvelopesInterpolator>(e);
+        });
+    }
+}
+
+void NumaReplicatedInterpolator::interpolate(float s, float* targetbuffer)
+{
+    local().interpolate(s, targetbuffer);
+}
+
+void NumaReplicatedInterpolator::setEnvelopeTable(const EnvelopeTable& e)
+{
+    for (int node = 0; node < numberOfReplicas(); node++) {
+        runOnNode(node, [&] { _replicas[node]->setEnvelopeTable(e); });
+    }
+}
+
+EnvelopesInterpolator& NumaReplicatedInterpolator::local()
+{
+    return *_replicas[localNode()];
+}
+
+int NumaReplicatedInterpolator::localNode() const
+{
+    int node = _topology.currentNode();
+    return (node >= 0 && node < static_cast<int>(_replicas.size())) ? node : 0;
+}
+
+void NumaReplicatedInterpolator::runOnNode(int node, const std::function<void()>& job)
+{
+    if (node >= static_cast<int>(_topology.cpusOfNode.size()) || _topology.cpusOfNode[node].empty()) {
+        job();
+        return;
+    }
+
+    std::thread worker([&] {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : _topology.cpusOfNode[node]) CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+        job();
+    });
+    worker.join();
+}
@@ -0,0 +1,278 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EnvelopesInterpolator.h"
+#include "EnvelopeTracing.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/*
+    Batch renderer: renders a list of interpolation factors from a table file, in parallel, and
+    writes the envelopes as raw floats, CSV or WAV. Prints throughput and peak memory at exit.
+
+    Usage: batch_render <job file>
+
+    The job file holds "key = value" lines ('#' starts a comment):
+
+        table = bank.f32        # raw 32-bit floats, numberOfShapes * envsize points
+        envsize = 100
+        peaks = 3, 1, 98, 15    # one per shape
+        s = 0, 1.5, 2.2         # interpolation factors, or:
+        sweep = 0 : 4 : 64      # start : end : count, end excluded
+        length = 100            # points per output envelope, resampled (default: envsize)
+        format = wav            # bin | csv | wav
+        output = out.wav
+        threads = 4             # default: hardware concurrency
+        samplerate = 48000      # wav header only
+        trace = trace.json      # Chrome trace of the run, when built with ENVELOPES_TRACING
+*/
+
+struct Job {
+    std::string table;
+    int envsize = 0;
+    std::vector<int> peaks;
+    std::vector<float> factors;
+    int length = 0;
+    std::string format = "bin";
+    std::string output;
+    int threads = 0;
+    int samplerate = 48000;
+    std::string trace;
+};
+
+static std::string trim(const std::string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return "";
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::string& text, char separator)
+{
+    std::vector<T> values;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, separator)) {
+        std::stringstream value(trim(item));
+        T v;
+        if (value >> v) values.push_back(v);
+    }
+    return values;
+}
+
+static bool readJob(const std::string& path, Job& job)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "cannot open job file " << path << "\n";
+        return false;
+    }
+
+    std::map<std::string, std::string> entries;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        entries[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+
+    job.table = entries["table"];
+    job.envsize = std::atoi(entries["envsize"].c_str());
+    job.peaks = parseList<int>(entries["peaks"], ',');
+    job.factors = parseList<float>(entries["s"], ',');
+    if (entries.count("sweep")) {
+        std::vector<float> sweep = parseList<float>(entries["sweep"], ':');
+        if (sweep.size() == 3) {
+            int count = static_cast<int>(sweep[2]);
+            for (int i = 0; i < count; i++) job.factors.push_back(sweep[0] + (sweep[1] - sweep[0]) * i / count);
+        }
+    }
+    job.length = entries.count("length") ? std::atoi(entries["length"].c_str()) : job.envsize;
+    if (entries.count("format")) job.format = entries["format"];
+    job.output = entries["output"];
+    if (entries.count("threads")) job.threads = std::atoi(entries["threads"].c_str());
+    if (entries.count("samplerate")) job.samplerate = std::atoi(entries["samplerate"].c_str());
+    job.trace = entries["trace"];
+
+    if (job.table.empty() || job.output.empty() || job.envsize < 2 || job.peaks.empty() || job.factors.empty() || job.length < 1) {
+        std::cerr << "job file must define table, envsize, peaks, s or sweep, and output\n";
+        return false;
+    }
+    for (int peak : job.peaks) {
+        if (peak < 0 || peak >= job.envsize) {
+            std::cerr << "peak " << peak << " is out of range [0, " << job.envsize << ")\n";
+            return false;
+        }
+    }
+    if (job.format != "bin" && job.format != "csv" && job.format != "wav") {
+        std::cerr << "unknown format " << job.format << "\n";
+        return false;
+    }
+    return true;
+}
+
+//renders envelopes [first, last) of the job into output, one envelope every job.length floats
+static void renderSlice(EnvelopesInterpolator& et, const Job& job, size_t first, size_t last, float* output)
+{
+    ENVELOPES_TRACE_SCOPE("render slice");
+    std::vector<float> envelope(job.envsize);
+
+    for (size_t n = first; n < last; n++) {
+        float* target = output + n * job.length;
+
+        if (job.length == job.envsize) {
+            et.interpolate(job.factors[n], target);
+            continue;
+        }
+
+        et.interpolate(job.factors[n], envelope.data());
+        for (int i = 0; i < job.length; i++) {
+            float x = (job.length > 1) ? static_cast<float>(i) * (job.envsize - 1) / (job.length - 1) : 0;
+            int x0 = static_cast<int>(x);
+            int x1 = std::min(x0 + 1, job.envsize - 1);
+            float t = x - x0;
+            target[i] = envelope[x0] + t * (envelope[x1] - envelope[x0]);
+        }
+    }
+}
+
+template <typename T>
+static void writeLE(std::ofstream& file, T value)
+{
+    //WAV headers are little-endian, as are the hosts this tool targets
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool writeOutput(const Job& job, const std::vector<float>& output)
+{
+    ENVELOPES_TRACE_SCOPE("write output");
+    std::ofstream file(job.output, std::ios::binary);
+    if (!file) {
+        std::cerr << "cannot open output " << job.output << "\n";
+        return false;
+    }
+
+    if (job.format == "csv") {
+        for (size_t n = 0; n < job.factors.size(); n++) {
+            for (int i = 0; i < job.length; i++) {
+                file << (i ? "," : "") << output[n * job.length + i];
+            }
+            file << "\n";
+        }
+        return static_cast<bool>(file);
+    }
+
+    uint32_t dataBytes = static_cast<uint32_t>(output.size() * sizeof(float));
+    if (job.format == "wav") {
+        //mono 32-bit IEEE float
+        file.write("RIFF", 4);
+        writeLE<uint32_t>(file, 36 + dataBytes);
+        file.write("WAVEfmt ", 8);
+        writeLE<uint32_t>(file, 16);
+        writeLE<uint16_t>(file, 3);
+        writeLE<uint16_t>(file, 1);
+        writeLE<uint32_t>(file, job.samplerate);
+        writeLE<uint32_t>(file, job.samplerate * sizeof(float));
+        writeLE<uint16_t>(file, sizeof(float));
+        writeLE<uint16_t>(file, 32);
+        file.write("data", 4);
+        writeLE<uint32_t>(file, dataBytes);
+    }
+    file.write(reinterpret_cast<const char*>(output.data()), dataBytes);
+    return static_cast<bool>(file);
+}
+
+static long peakRSSKilobytes()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <job file>\n";
+        return 1;
+    }
+
+    Job job;
+    if (!readJob(argv[1], job)) return 1;
+    Tracer::setEnabled(!job.trace.empty());
+
+    int numberOfShapes = static_cast<int>(job.peaks.size());
+    std::vector<float> data(static_cast<size_t>(numberOfShapes) * job.envsize);
+    std::ifstream table(job.table, std::ios::binary);
+    if (!table.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float))) {
+        std::cerr << "table " << job.table << " must hold " << numberOfShapes << " x " << job.envsize << " floats\n";
+        return 1;
+    }
+
+    EnvelopesInterpolator et(job.envsize);
+    et.setEnvelopeTable({ data.data(), job.envsize, numberOfShapes, { job.peaks.begin(), job.peaks.end() } });
+    if (et.getNumberOfShapes() != numberOfShapes) {
+        std::cerr << "invalid table: shapes must start and end at zero\n";
+        return 1;
+    }
+
+    for (float s : job.factors) {
+        if (s < 0 || s >= numberOfShapes) {
+            std::cerr << "s = " << s << " is out of range [0, " << numberOfShapes << ")\n";
+            return 1;
+        }
+    }
+
+    size_t count = job.factors.size();
+    std::vector<float> output(count * job.length);
+
+    int threads = job.threads > 0 ? job.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<int>(std::min<size_t>(threads, count));
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        size_t first = count * t / threads;
+        size_t last = count * (t + 1) / threads;
+        workers.emplace_back(renderSlice, std::ref(et), std::cref(job), first, last, output.data());
+    }
+    for (auto& worker : workers) worker.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!writeOutput(job, output)) return 1;
+
+    if (!job.trace.empty()) {
+        Tracer::setEnabled(false);
+        std::ofstream trace(job.trace);
+        Tracer::writeChromeTrace(trace);
+    }
+
+    double seconds = std::max(elapsed.count(), 1e-9);
+    std::cout << count << " envelopes of " << job.length << " points in " << seconds * 1000 << " ms on " << threads << " threads\n";
+    std::cout << "envelopes/sec: " << count / seconds << "\n";
+    std::cout << "MB/s: " << output.size() * sizeof(float) / seconds / 1e6 << "\n";
+    std::cout << "peak RSS: " << peakRSSKilobytes() << " kB\n";
+
+    return 0;
+}
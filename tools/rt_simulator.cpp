@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "DoubleBuffer.h"
+#include "EnvelopeMetrics.h"
+#include "EnvelopesInterpolator.h"
+
+/*
+    Real-time callback simulator: runs a periodic "audio" thread that renders an envelope into a
+    DoubleBuffer and swaps it on every callback, as an audio callback would, while background
+    threads load the memory system and the envelope table is optionally replaced under it.
+    Writes JSON with render time and wakeup jitter percentiles, deadline misses and a jitter
+    histogram.
+
+    Usage: rt_simulator [key=value ...]
+
+        blocksize = 64          # samples per callback
+        samplerate = 48000      # the callback period is blocksize / samplerate
+        duration = 10           # seconds
+        envsize = 4096          # points of the rendered envelope
+        shapes = 16
+        load = 2                # background threads streaming through a large buffer
+        loadmb = 64             # size of the buffer of each background thread
+        swaps = 0               # table replacements per second, 0 for none
+        priority = 80           # SCHED_FIFO priority of the audio thread, 0 for none
+        bin = 5                 # width of the jitter histogram bins, in microseconds
+        output = result.json    # default: standard output
+
+    SCHED_FIFO and mlockall usually need privileges: whether they were granted is part of the
+    output, the simulation running in any case.
+
+    Table swaps follow the pattern the audio thread can afford: the new interpolator is built on
+    another thread and published through an atomic pointer, the audio thread only loading it at
+    the start of a callback. The previous table is freed once the audio thread has started a
+    callback after the swap, so no allocation or deallocation ever happens on the audio thread. The
+    audio thread also registers with the metrics registry before its first callback, since taking
+    its shard on the first render would lock and allocate.
+*/
+
+struct Config {
+    int blocksize = 64;
+    int samplerate = 48000;
+    double duration = 10;
+    int envsize = 4096;
+    int shapes = 16;
+    int load = 2;
+    int loadmb = 64;
+    double swaps = 0;
+    int priority = 80;
+    int bin = 5;
+    std::string output;
+};
+
+struct Summary {
+    double mean = 0, p50 = 0, p99 = 0, p999 = 0, max = 0;
+};
+
+static bool parseArguments(int argc, char** argv, Config& config)
+{
+    std::map<std::string, std::string> entries;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        size_t equals = argument.find('=');
+        if (equals == std::string::npos) {
+            std::cerr << "expected key=value, got " << argument << "\n";
+            return false;
+        }
+        entries[argument.substr(0, equals)] = argument.substr(equals + 1);
+    }
+
+    for (const auto& entry : entries) {
+        std::stringstream value(entry.second);
+        bool ok;
+        if (entry.first == "blocksize") ok = static_cast<bool>(value >> config.blocksize);
+        else if (entry.first == "samplerate") ok = static_cast<bool>(value >> config.samplerate);
+        else if (entry.first == "duration") ok = static_cast<bool>(value >> config.duration);
+        else if (entry.first == "envsize") ok = static_cast<bool>(value >> config.envsize);
+        else if (entry.first == "shapes") ok = static_cast<bool>(value >> config.shapes);
+        else if (entry.first == "load") ok = static_cast<bool>(value >> config.load);
+        else if (entry.first == "loadmb") ok = static_cast<bool>(value >> config.loadmb);
+        else if (entry.first == "swaps") ok = static_cast<bool>(value >> config.swaps);
+        else if (entry.first == "priority") ok = static_cast<bool>(value >> config.priority);
+        else if (entry.first == "bin") ok = static_cast<bool>(value >> config.bin);
+        else if (entry.first == "output") ok = !(config.output = entry.second).empty();
+        else {
+            std::cerr << "unknown key " << entry.first << "\n";
+            return false;
+        }
+        if (!ok) {
+            std::cerr << "invalid value for " << entry.first << ": " << entry.second << "\n";
+            return false;
+        }
+    }
+
+    if (config.blocksize <= 0 || config.samplerate <= 0 || config.duration <= 0 || config.envsize < 3 || config.shapes < 1 || config.bin <= 0) {
+        std::cerr << "blocksize, samplerate, duration, shapes and bin must be positive, envsize at least 3\n";
+        return false;
+    }
+    return true;
+}
+
+//a table of triangles whose peaks depend on the seed, so that every swap changes the morph
+static EnvelopesInterpolator* makeInterpolator(const Config& config, int seed)
+{
+    EnvelopesInterpolator* et = new EnvelopesInterpolator(config.envsize);
+    std::vector<std::vector<std::pair<int, float>>> shapes;
+    std::vector<int> peaks;
+    for (int n = 0; n < config.shapes; n++) {
+        int peak = 1 + (n * 7919 + seed * 104729) % (config.envsize - 2);
+        shapes.push_back({ { 0, 0.0f }, { peak, 1.0f }, { config.envsize - 1, 0.0f } });
+        peaks.push_back(peak);
+    }
+    et->addLinearShapes(shapes, peaks, 1);
+    return et;
+}
+
+static std::int64_t nanoseconds(const timespec& t)
+{
+    return static_cast<std::int64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+static Summary summarize(std::vector<std::int64_t> values)
+{
+    Summary summary;
+    if (values.empty()) return summary;
+    std::sort(values.begin(), values.end());
+    auto at = [&](double q) { return static_cast<double>(values[std::min(values.size() - 1, static_cast<size_t>(q * values.size()))]); };
+
+    double sum = 0;
+    for (std::int64_t v : values) sum += static_cast<double>(v);
+    summary.mean = sum / values.size();
+    summary.p50 = at(0.5);
+    summary.p99 = at(0.99);
+    summary.p999 = at(0.999);
+    summary.max = static_cast<double>(values.back());
+    return summary;
+}
+
+static void writeSummary(std::ostream& os, const char* name, const Summary& summary)
+{
+    os << "  \"" << name << "\": { \"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p99\": " << summary.p99
+       << ", \"p999\": " << summary.p999 << ", \"max\": " << summary.max << " },\n";
+}
+
+int main(int argc, char** argv)
+{
+    Config config;
+    if (!parseArguments(argc, argv, config)) return 1;
+
+    const std::int64_t period = static_cast<std::int64_t>(1e9 * config.blocksize / config.samplerate);
+    const size_t callbacks = static_cast<size_t>(config.duration * 1e9 / period);
+
+    std::atomic<EnvelopesInterpolator*> current(makeInterpolator(config, 0));
+    std::atomic<std::uint64_t> callbacksStarted(0);
+    std::atomic<bool> running(true);
+    std::atomic<std::uint64_t> loadChecksum(0);
+
+    //measurements, allocated up front
+    std::vector<std::int64_t> renderTimes(callbacks);
+    std::vector<std::int64_t> wakeupJitter(callbacks);
+    size_t deadlineMisses = 0;
+    bool fifoGranted = false;
+    bool memoryLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+
+    //background load: streaming reads and writes through buffers larger than the last level cache
+    std::vector<std::thread> loadThreads;
+    for (int t = 0; t < config.load; t++) {
+        loadThreads.emplace_back([&] {
+            std::vector<std::uint64_t> buffer(static_cast<size_t>(config.loadmb) * 1024 * 1024 / sizeof(std::uint64_t), 1);
+            std::uint64_t sum = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                for (size_t i = 0; i < buffer.size(); i += 8) {
+                    sum += buffer[i];
+                    buffer[i] = sum;
+                }
+            }
+            loadChecksum.fetch_add(sum);
+        });
+    }
+
+    size_t swapsDone = 0;
+    std::thread swapThread;
+    if (config.swaps > 0) {
+        swapThread = std::thread([&] {
+            auto interval = std::chrono::duration<double>(1.0 / config.swaps);
+            for (int seed = 1; running.load(std::memory_order_relaxed); seed++) {
+                std::this_thread::sleep_for(interval);
+                //the exchange and the load of the counter must not be reordered against the audio
+                //thread's increment and load (store buffering): both pairs are sequentially consistent
+                EnvelopesInterpolator* previous = current.exchange(makeInterpolator(config, seed), std::memory_order_seq_cst);
+
+                //once a callback has started after the exchange, none can still be using the previous table
+                std::uint64_t started = callbacksStarted.load(std::memory_order_seq_cst);
+                while (callbacksStarted.load(std::memory_order_acquire) < started + 1 && running.load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                delete previous;
+                swapsDone++;
+            }
+        });
+    }
+
+    std::thread audioThread([&] {
+        if (config.priority > 0) {
+            sched_param parameters{};
+            parameters.sched_priority = config.priority;
+            fifoGranted = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) == 0;
+        }
+
+        //the metrics shard of this thread is taken now rather than in the first callback
+        MetricsRegistry::global().registerThread();
+
+        DoubleBuffer db(config.envsize);
+        float axis = static_cast<float>(config.shapes);
+
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        for (size_t c = 0; c < callbacks; c++) {
+            next.tv_nsec += period;
+            while (next.tv_nsec >= 1000000000) {
+                next.tv_nsec -= 1000000000;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+            timespec woke, done;
+            clock_gettime(CLOCK_MONOTONIC, &woke);
+            callbacksStarted.fetch_add(1, std::memory_order_seq_cst);
+
+            //the render path: slow sweep of s, render into the inactive buffer, hand it over
+            const EnvelopesInterpolator* et = current.load(std::memory_order_seq_cst);
+            float s = std::fmod(static_cast<float>(c) * 0.001f, axis);
+            et->interpolate(s, db.getInactiveBuffer());
+            db.swapBuffers();
+
+            clock_gettime(CLOCK_MONOTONIC, &done);
+            renderTimes[c] = nanoseconds(done) - nanoseconds(woke);
+            wakeupJitter[c] = nanoseconds(woke) - nanoseconds(next);
+            //the block must be ready before the next callback is due
+            if (nanoseconds(done) > nanoseconds(next) + period) deadlineMisses++;
+        }
+    });
+
+    audioThread.join();
+    running.store(false);
+    for (auto& thread : loadThreads) thread.join();
+    if (swapThread.joinable()) swapThread.join();
+    delete current.load();
+
+    //jitter histogram in bins of config.bin microseconds, the last bin gathering everything beyond
+    const int bins = 50;
+    std::vector<size_t> histogram(bins, 0);
+    for (std::int64_t jitter : wakeupJitter) {
+        std::int64_t bin = std::max<std::int64_t>(jitter, 0) / (config.bin * 1000);
+        histogram[static_cast<size_t>(std::min<std::int64_t>(bin, bins - 1))]++;
+    }
+
+    std::ofstream file;
+    if (!config.output.empty()) {
+        file.open(config.output);
+        if (!file) {
+            std::cerr << "cannot open " << config.output << "\n";
+            return 1;
+        }
+    }
+    std::ostream& os = config.output.empty() ? std::cout : file;
+
+    os << "{\n";
+    os << "  \"config\": { \"blocksize\": " << config.blocksize << ", \"samplerate\": " << config.samplerate << ", \"duration\": " << config.duration
+       << ", \"envsize\": " << config.envsize << ", \"shapes\": " << config.shapes << ", \"load_threads\": " << config.load
+       << ", \"load_mb\": " << config.loadmb << ", \"swaps_per_second\": " << config.swaps << ", \"priority\": " << config.priority << " },\n";
+    os << "  \"sched_fifo\": " << (fifoGranted ? "true" : "false") << ",\n";
+    os << "  \"memory_locked\": " << (memoryLocked ? "true" : "false") << ",\n";
+    os << "  \"period_ns\": " << period << ",\n";
+    os << "  \"callbacks\": " << callbacks << ",\n";
+    os << "  \"table_swaps\": " << swapsDone << ",\n";
+    os << "  \"deadline_misses\": " << deadlineMisses << ",\n";
+    writeSummary(os, "render_ns", summarize(renderTimes));
+    writeSummary(os, "wakeup_jitter_ns", summarize(wakeupJitter));
+    os << "  \"jitter_histogram\": { \"bin_us\": " << config.bin << ", \"counts\": [";
+    for (int b = 0; b < bins; b++) os << (b > 0 ? ", " : "") << histogram[b];
+    os << "] }\n";
+    os << "}\n";
+
+    return 0;
+}